@@ -0,0 +1,439 @@
+/*
+ * bitboard.c
+ * Bitboard position representation and attack detection.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include "stddef.h"
+#include "boardutil.h"
+#include "bitboard.h"
+
+//Use PEXT for sliding attack lookups on CPUs that support BMI2
+#define PEXT_ENABLED TRUE
+
+//Ray directions, the first four run toward higher squares
+#define NORTH 0
+#define EAST 1
+#define NORTH_EAST 2
+#define NORTH_WEST 3
+#define SOUTH 4
+#define WEST 5
+#define SOUTH_EAST 6
+#define SOUTH_WEST 7
+
+/* Attack tables */
+Bitboard knightAttacks[64];
+Bitboard kingAttacks[64];
+Bitboard pawnAttacks[2][64];
+Magic rookMagics[64];
+Magic bishopMagics[64];
+Bitboard betweenSquares[64][64];
+char usePext = FALSE;
+Bitboard pieceKeys[2][7][64];
+Bitboard castleKeys[16];
+Bitboard passantKeys[8];
+Bitboard sideKey;
+static Bitboard rays[8][64];	//squares in each direction from a square, to the edge
+static Bitboard rookTable[102400];	//attack sets for every square and relevant occupancy
+static Bitboard bishopTable[5248];
+static Bitboard magicSeed = 728429ULL;
+static Bitboard keySeed = 1070372ULL;
+
+static void initMagics();
+static void initKeys();
+
+/*
+ * Returns the bit for (row, col) or 0 if it is off the board.
+ */
+static Bitboard squareBit(int row, int col)
+{
+	if (row < 0 || row > 7 || col < 0 || col > 7)
+		return 0;
+	return SQUARE_BIT(SQUARE(row, col));
+}
+
+/*
+ * Fill the attack tables.  Must be called once before any other
+ * bitboard function is used.
+ */
+void initBitboards()
+{
+	int square, row, col, i;
+	int rowSteps[8] = {1, 0, 1, 1, -1, 0, -1, -1};
+	int colSteps[8] = {0, 1, 1, -1, 0, -1, 1, -1};
+
+	for (square = 0; square < 64; square++)
+	{
+		row = ROW_OF(square);
+		col = COL_OF(square);
+
+		knightAttacks[square] = squareBit(row + 2, col + 1) | squareBit(row + 2, col - 1) |
+			squareBit(row + 1, col + 2) | squareBit(row + 1, col - 2) |
+			squareBit(row - 2, col + 1) | squareBit(row - 2, col - 1) |
+			squareBit(row - 1, col + 2) | squareBit(row - 1, col - 2);
+
+		kingAttacks[square] = squareBit(row + 1, col) | squareBit(row - 1, col) |
+			squareBit(row, col + 1) | squareBit(row, col - 1) |
+			squareBit(row + 1, col + 1) | squareBit(row + 1, col - 1) |
+			squareBit(row - 1, col + 1) | squareBit(row - 1, col - 1);
+
+		pawnAttacks[WHITE_INDEX][square] = squareBit(row + 1, col - 1) | squareBit(row + 1, col + 1);
+		pawnAttacks[BLACK_INDEX][square] = squareBit(row - 1, col - 1) | squareBit(row - 1, col + 1);
+
+		for (i = 0; i < 8; i++)
+		{
+			int r = row + rowSteps[i];
+			int c = col + colSteps[i];
+			rays[i][square] = 0;
+			while (r >= 0 && r < 8 && c >= 0 && c < 8)
+			{
+				rays[i][square] |= SQUARE_BIT(SQUARE(r, c));
+				r += rowSteps[i];
+				c += colSteps[i];
+			}
+		}
+	}
+
+	//squares strictly between two squares on a line
+	for (square = 0; square < 64; square++)
+	{
+		int other;
+		for (other = 0; other < 64; other++)
+			betweenSquares[square][other] = 0;
+		for (i = 0; i < 8; i++)
+		{
+			Bitboard ray = rays[i][square];
+			while (ray != 0)
+			{
+				other = popSquare(&ray);
+				betweenSquares[square][other] = rays[i][square] & ~rays[i][other] & ~SQUARE_BIT(other);
+			}
+		}
+	}
+
+	initMagics();
+	initKeys();
+}
+
+/*
+ * Build a position from a char* board.  White is to move, castling is
+ * left allowed and no pawn may be taken en passant.
+ */
+void boardToPosition(char* board, Position* pos)
+{
+	int square, type;
+	for (type = 0; type < 7; type++)
+	{
+		pos->pieces[WHITE_INDEX][type] = 0;
+		pos->pieces[BLACK_INDEX][type] = 0;
+	}
+	pos->colors[WHITE_INDEX] = 0;
+	pos->colors[BLACK_INDEX] = 0;
+	pos->occupied = 0;
+	pos->castleFlags = 0;
+	pos->passantSquare = -1;
+	pos->sideToMove = WHITE;
+	pos->key = 0;
+
+	for (square = 0; square < 64; square++)
+	{
+		pos->mailbox[square] = EMPTY;
+		if (board[square] != EMPTY)
+			addPiece(pos, square, board[square]);
+	}
+}
+
+/*
+ * Copy a position back into a char* board.
+ */
+void positionToBoard(Position* pos, char* board)
+{
+	int square;
+	for (square = 0; square < 64; square++)
+		board[square] = pos->mailbox[square];
+}
+
+/*
+ * Compute a position's Zobrist key from scratch.  Used to check the key
+ * kept up to date as moves are made.
+ */
+Bitboard computeKey(Position* pos)
+{
+	Bitboard key = castleKeys[(int) pos->castleFlags];
+	int square;
+	for (square = 0; square < 64; square++)
+	{
+		char pieceId = pos->mailbox[square];
+		if (pieceId != EMPTY)
+			key ^= pieceKeys[isBlack(pieceId) ? BLACK_INDEX : WHITE_INDEX][PIECE_TYPE(pieceId)][square];
+	}
+	if (pos->passantSquare >= 0)
+		key ^= passantKeys[COL_OF(pos->passantSquare)];
+	if (pos->sideToMove == BLACK)
+		key ^= sideKey;
+	return key;
+}
+
+/*
+ * Place a piece on an empty square.
+ */
+void addPiece(Position* pos, int square, char pieceId)
+{
+	Bitboard bit = SQUARE_BIT(square);
+	int color = isBlack(pieceId) ? BLACK_INDEX : WHITE_INDEX;
+	pos->pieces[color][PIECE_TYPE(pieceId)] |= bit;
+	pos->colors[color] |= bit;
+	pos->occupied |= bit;
+	pos->mailbox[square] = pieceId;
+	pos->key ^= pieceKeys[color][PIECE_TYPE(pieceId)][square];
+}
+
+/*
+ * Remove the piece from an occupied square.
+ */
+void removePiece(Position* pos, int square)
+{
+	Bitboard bit = SQUARE_BIT(square);
+	char pieceId = pos->mailbox[square];
+	int color = isBlack(pieceId) ? BLACK_INDEX : WHITE_INDEX;
+	pos->pieces[color][PIECE_TYPE(pieceId)] &= ~bit;
+	pos->colors[color] &= ~bit;
+	pos->occupied &= ~bit;
+	pos->mailbox[square] = EMPTY;
+	pos->key ^= pieceKeys[color][PIECE_TYPE(pieceId)][square];
+}
+
+/*
+ * Squares reached along one ray, stopping at (and including) the first
+ * occupied square.
+ */
+static Bitboard rayAttacks(int direction, int square, Bitboard occupied)
+{
+	Bitboard attacks = rays[direction][square];
+	Bitboard blockers = attacks & occupied;
+	if (blockers != 0)
+	{
+		if (direction < SOUTH)
+			attacks ^= rays[direction][lowestSquare(blockers)];
+		else
+			attacks ^= rays[direction][highestSquare(blockers)];
+	}
+	return attacks;
+}
+
+/*
+ * Squares attacked by a rook or bishop, walked ray by ray.  Used to fill
+ * the lookup tables.
+ */
+static Bitboard slowSlidingAttacks(int bishop, int square, Bitboard occupied)
+{
+	if (bishop)
+		return rayAttacks(NORTH_EAST, square, occupied) | rayAttacks(NORTH_WEST, square, occupied) |
+			rayAttacks(SOUTH_EAST, square, occupied) | rayAttacks(SOUTH_WEST, square, occupied);
+	else
+		return rayAttacks(NORTH, square, occupied) | rayAttacks(SOUTH, square, occupied) |
+			rayAttacks(EAST, square, occupied) | rayAttacks(WEST, square, occupied);
+}
+
+/*
+ * Pseudo-random numbers for the magic search and the Zobrist keys
+ * (xorshift), seeded so that every node builds the same tables.
+ */
+static Bitboard nextRandom(Bitboard* seed)
+{
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return *seed * 2685821657736338717ULL;
+}
+
+/*
+ * Fill the sliding attack table for one square.  With PEXT the index is
+ * the occupancy bits packed together; otherwise search for a magic
+ * multiplier that maps every occupancy to a slot without a harmful
+ * collision.  Returns the number of table entries used.
+ */
+static int initMagic(int bishop, int square, Magic* m, Bitboard* table)
+{
+	Bitboard occupancies[4096];
+	Bitboard attacks[4096];
+	int epoch[4096];
+	int bits, size, i, attempt;
+
+	//relevant occupancy: the rays without the board edge squares they end on
+	Bitboard edges = ((ROW_BITS(0) | ROW_BITS(7)) & ~ROW_BITS(ROW_OF(square))) |
+		((FILE_A | FILE_H) & ~(FILE_A << COL_OF(square)));
+	m->mask = slowSlidingAttacks(bishop, square, 0) & ~edges;
+	bits = popCount(m->mask);
+	m->shift = 64 - bits;
+	m->attacks = table;
+	m->magic = 0;
+	size = 1 << bits;
+
+	//enumerate every subset of the mask (carry-rippler)
+	Bitboard subset = 0;
+	for (i = 0; i < size; i++)
+	{
+		occupancies[i] = subset;
+		attacks[i] = slowSlidingAttacks(bishop, square, subset);
+		subset = (subset - m->mask) & m->mask;
+	}
+
+	if (usePext)
+	{
+		for (i = 0; i < size; i++)
+			table[magicIndex(m, occupancies[i])] = attacks[i];
+		return size;
+	}
+
+	for (i = 0; i < size; i++)
+		epoch[i] = 0;
+	for (attempt = 1; ; attempt++)
+	{
+		//candidates with few bits set make good magics
+		m->magic = nextRandom(&magicSeed) & nextRandom(&magicSeed) & nextRandom(&magicSeed);
+		if (popCount((m->mask * m->magic) >> 56) < 6)
+			continue;
+
+		for (i = 0; i < size; i++)
+		{
+			unsigned int index = magicIndex(m, occupancies[i]);
+			if (epoch[index] < attempt)
+			{
+				epoch[index] = attempt;
+				table[index] = attacks[i];
+			} else if (table[index] != attacks[i]) {
+				break;	//collision with different attacks, try another magic
+			}
+		}
+		if (i == size)
+			return size;
+	}
+}
+
+/*
+ * Fill the rook and bishop lookup tables for every square.
+ */
+static void initMagics()
+{
+	int square;
+	int rookUsed = 0;
+	int bishopUsed = 0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	usePext = PEXT_ENABLED && __builtin_cpu_supports("bmi2");
+#endif
+
+	for (square = 0; square < 64; square++)
+	{
+		rookUsed += initMagic(FALSE, square, &rookMagics[square], rookTable + rookUsed);
+		bishopUsed += initMagic(TRUE, square, &bishopMagics[square], bishopTable + bishopUsed);
+	}
+}
+
+/*
+ * Fill the Zobrist key tables.  Each castling flag gets its own key and
+ * castleKeys[] holds the combination for every set of flags.
+ */
+static void initKeys()
+{
+	int color, type, square, flags, i;
+	Bitboard flagKeys[4];
+
+	for (color = 0; color < 2; color++)
+		for (type = 0; type < 7; type++)
+			for (square = 0; square < 64; square++)
+				pieceKeys[color][type][square] = nextRandom(&keySeed);
+	for (i = 0; i < 4; i++)
+		flagKeys[i] = nextRandom(&keySeed);
+	for (flags = 0; flags < 16; flags++)
+	{
+		castleKeys[flags] = 0;
+		for (i = 0; i < 4; i++)
+			if (flags & (1 << i))
+				castleKeys[flags] ^= flagKeys[i];
+	}
+	for (i = 0; i < 8; i++)
+		passantKeys[i] = nextRandom(&keySeed);
+	sideKey = nextRandom(&keySeed);
+}
+
+/*
+ * Returns TRUE if a square is attacked by any piece of the given color.
+ */
+char squareAttacked(Position* pos, int square, int color)
+{
+	int them = COLOR_INDEX(color);
+	Bitboard* pieces = pos->pieces[them];
+
+	if (pawnAttacks[1 - them][square] & pieces[PAWN])
+		return TRUE;
+	if (knightAttacks[square] & pieces[KNIGHT])
+		return TRUE;
+	if (kingAttacks[square] & pieces[KING])
+		return TRUE;
+	if (bishopAttacks(square, pos->occupied) & (pieces[BISHOP] | pieces[QUEEN]))
+		return TRUE;
+	if (rookAttacks(square, pos->occupied) & (pieces[ROOK] | pieces[QUEEN]))
+		return TRUE;
+	return FALSE;
+}
+
+/*
+ * Returns the pieces of the given color that attack a square, with
+ * sliding attacks computed through the given occupancy.
+ */
+Bitboard attackersOf(Position* pos, int square, int color, Bitboard occupied)
+{
+	int them = COLOR_INDEX(color);
+	Bitboard* pieces = pos->pieces[them];
+
+	return (pawnAttacks[1 - them][square] & pieces[PAWN]) |
+		(knightAttacks[square] & pieces[KNIGHT]) |
+		(kingAttacks[square] & pieces[KING]) |
+		(bishopAttacks(square, occupied) & (pieces[BISHOP] | pieces[QUEEN])) |
+		(rookAttacks(square, occupied) & (pieces[ROOK] | pieces[QUEEN]));
+}
+
+/*
+ * Returns every square attacked by pieces of the given color.
+ */
+Bitboard attackedSquares(Position* pos, int color)
+{
+	int us = COLOR_INDEX(color);
+	Bitboard* pieces = pos->pieces[us];
+	Bitboard attacks, b;
+
+	//pawns attack diagonally forward, shifted as a group
+	if (us == WHITE_INDEX)
+		attacks = ((pieces[PAWN] & ~FILE_A) << 7) | ((pieces[PAWN] & ~FILE_H) << 9);
+	else
+		attacks = ((pieces[PAWN] & ~FILE_A) >> 9) | ((pieces[PAWN] & ~FILE_H) >> 7);
+
+	for (b = pieces[KNIGHT]; b != 0; )
+		attacks |= knightAttacks[popSquare(&b)];
+	for (b = pieces[BISHOP] | pieces[QUEEN]; b != 0; )
+		attacks |= bishopAttacks(popSquare(&b), pos->occupied);
+	for (b = pieces[ROOK] | pieces[QUEEN]; b != 0; )
+		attacks |= rookAttacks(popSquare(&b), pos->occupied);
+	if (pieces[KING] != 0)
+		attacks |= kingAttacks[lowestSquare(pieces[KING])];
+
+	return attacks;
+}
+
+/*
+ * Returns TRUE if the king of the given color is in check.
+ */
+char positionInCheck(Position* pos, int color)
+{
+	Bitboard king = pos->pieces[COLOR_INDEX(color)][KING];
+	if (king == 0)
+		return FALSE;
+	if (color == WHITE)
+		return squareAttacked(pos, lowestSquare(king), BLACK);
+	else
+		return squareAttacked(pos, lowestSquare(king), WHITE);
+}
@@ -0,0 +1,135 @@
+/*
+ * bitboard.h
+ * Bitboard position representation and attack detection.
+ * Requires boardutil.h.
+ */
+
+/* Types */
+typedef unsigned long long Bitboard;
+
+//Position structure, one bit per square (bit index = row * 8 + col)
+typedef struct
+{
+	Bitboard pieces[2][7];	//occupancy by color index and piece type
+	Bitboard colors[2];	//occupancy by color index
+	Bitboard occupied;	//all occupied squares
+	char mailbox[64];	//piece id on each square, same layout as char* board
+	char castleFlags;	//castling flags (see below) for this position
+	char passantSquare;	//pawn that may be taken en passant, or -1
+	char sideToMove;	//WHITE or BLACK
+	Bitboard key;		//Zobrist key, kept up to date by addPiece() and removePiece()
+} Position;
+
+/* Defines */
+#define WHITE_INDEX 0
+#define BLACK_INDEX 1
+#define COLOR_INDEX(color) ((color) == BLACK ? BLACK_INDEX : WHITE_INDEX)
+#define PIECE_TYPE(pieceId) ((pieceId) > BLACK ? (pieceId) - BLACK : (pieceId))
+#define SQUARE(row, col) ((row) * 8 + (col))
+#define SQUARE_BIT(square) (1ULL << (square))
+#define ROW_OF(square) ((square) >> 3)
+#define COL_OF(square) ((square) & 7)
+#define ROW_BITS(row) (0xFFULL << ((row) * 8))
+
+//Castling flags, set once a side may no longer castle
+#define WHITE_KCASTLE_INVALID 1
+#define WHITE_QCASTLE_INVALID 2
+#define BLACK_KCASTLE_INVALID 4
+#define BLACK_QCASTLE_INVALID 8
+
+#define FILE_A 0x0101010101010101ULL
+#define FILE_H 0x8080808080808080ULL
+
+//Sliding attack lookup for one square.  The occupancy bits that matter
+//(mask) are turned into an index by a magic multiply, or by PEXT on
+//CPUs with BMI2.
+typedef struct
+{
+	Bitboard mask;		//relevant occupancy, board edges excluded
+	Bitboard magic;		//magic multiplier
+	Bitboard* attacks;	//attack sets for this square, by index
+	int shift;		//64 - number of bits in mask
+} Magic;
+
+/* Attack tables for pieces that do not slide */
+extern Bitboard knightAttacks[64];
+extern Bitboard kingAttacks[64];
+extern Bitboard pawnAttacks[2][64];	//squares attacked by a pawn of each color index
+
+/* Attack tables for sliding pieces */
+extern Magic rookMagics[64];
+extern Magic bishopMagics[64];
+extern Bitboard betweenSquares[64][64];	//squares strictly between two squares on a line, else 0
+extern char usePext;	//set by initBitboards() when the CPU supports BMI2
+
+/* Zobrist keys, the same on every node */
+extern Bitboard pieceKeys[2][7][64];	//by color index, piece type and square
+extern Bitboard castleKeys[16];		//by castling flags, castleKeys[0] is 0
+extern Bitboard passantKeys[8];		//by file of the en passant pawn
+extern Bitboard sideKey;		//present when black is to move
+
+/* Number of squares set on a bitboard. */
+inline int popCount(Bitboard b)
+{
+	return __builtin_popcountll(b);
+}
+
+/* Lowest square set on a (non-empty) bitboard. */
+inline int lowestSquare(Bitboard b)
+{
+	return __builtin_ctzll(b);
+}
+
+/* Highest square set on a (non-empty) bitboard. */
+inline int highestSquare(Bitboard b)
+{
+	return 63 - __builtin_clzll(b);
+}
+
+/* Remove the lowest square from a (non-empty) bitboard and return it. */
+inline int popSquare(Bitboard* b)
+{
+	int square = __builtin_ctzll(*b);
+	*b &= *b - 1;
+	return square;
+}
+
+/* Index of an occupancy in a square's attack table. */
+inline unsigned int magicIndex(Magic* m, Bitboard occupied)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (usePext)
+	{
+		Bitboard index;
+		__asm__("pextq %2, %1, %0" : "=r" (index) : "r" (occupied), "r" (m->mask));
+		return (unsigned int) index;
+	}
+#endif
+	return (unsigned int) (((occupied & m->mask) * m->magic) >> m->shift);
+}
+
+/* Squares attacked by a rook on a square. */
+inline Bitboard rookAttacks(int square, Bitboard occupied)
+{
+	Magic* m = &rookMagics[square];
+	return m->attacks[magicIndex(m, occupied)];
+}
+
+/* Squares attacked by a bishop on a square. */
+inline Bitboard bishopAttacks(int square, Bitboard occupied)
+{
+	Magic* m = &bishopMagics[square];
+	return m->attacks[magicIndex(m, occupied)];
+}
+
+/* Prototypes */
+void initBitboards();
+void boardToPosition(char* board, Position* pos);
+void positionToBoard(Position* pos, char* board);
+Bitboard computeKey(Position* pos);
+void addPiece(Position* pos, int square, char pieceId);
+void removePiece(Position* pos, int square);
+char squareAttacked(Position* pos, int square, int color);
+Bitboard attackersOf(Position* pos, int square, int color, Bitboard occupied);
+Bitboard attackedSquares(Position* pos, int color);
+char positionInCheck(Position* pos, int color);
@@ -12,7 +12,9 @@
 #include "stddef.h"
 #include "strutil.h"
 #include "boardutil.h"
+#include "bitboard.h"
 #include "moves.h"
+#include "ttable.h"
 #include <mpi.h>
 
 //General defines
@@ -23,10 +25,21 @@
 
 //Setup defines
 #define SEARCH_DEPTH 4
+#define MOVE_TIME 5.0	//seconds per computer move, or 0 to search SEARCH_DEPTH plies
+#define MOVE_NODES 0	//nodes per computer move, or 0 for no limit
+#define MAX_DEPTH 32	//deepest search within a move's budget
 #define TYPE_WHITE HUMAN
 #define TYPE_BLACK AI
 #define FUNCTION_WHITE TURING
 #define FUNCTION_BLACK TURING
+#define VERIFY_DEPTH 3
+#define VERIFY_FUNCTION ROB
+#define HASH_SIZE 64	//transposition table size in MB, on each node
+#define SEARCH_THREADS 4	//search threads when run on a single node
+#define NODE_THREADS 1	//search threads on each node when run on several
+#define SPLIT_SEARCH FALSE	//threads split the tree (YBW) instead of Lazy SMP
+#define NULL_MOVE TRUE	//null-move pruning in the search
+#define MOVE_REDUCTIONS TRUE	//late move reductions in the search
 
 //Use MPI namespace
 using namespace MPI;
@@ -39,6 +52,21 @@ Move** moveQueue;	// Queue for storing previously executed moves
 int queueIndex;		// Current position in array queue
 int queueFull;		// Whether queue has been filled yet
 
+//Positions checked by the search verification (-v), as logged move sequences
+const char* verifyPositions[] = {
+	"",
+	"e2e4 e7e5 g1f3 b8c6 f1c4 f8c5",
+	"d2d4 d7d5 c2c4 e7e6 b1c3 g8f6 c1g5 f8e7",
+	"e2e4 c7c5 g1f3 d7d6 d2d4 c5d4 f3d4 g8f6 b1c3 a7a6",
+	"e2e4 e7e5 g1f3 b8c6 f1b5 a7a6 b5a4 g8f6 CK f8e7",
+	"e2e4 d7d5 e4d5 d8d5 b1c3 d5a5 d2d4 g8f6 g1f3 c8f5",
+	"e2e4 e7e6 d2d4 d7d5 e4e5 c7c5 c2c3 b8c6 g1f3 d8b6",
+	"e2e4 g8f6 e4e5 d7d5",
+	"e2e4 d7d5 f1b5",
+	"d2d4 e7e5 d4e5 f8b4"
+};
+#define VERIFY_POSITIONS (int) (sizeof(verifyPositions) / sizeof(verifyPositions[0]))
+
 //Prototypes
 Move* strToMove(char* str);
 void printScore(int score);
@@ -49,24 +77,57 @@ void initLog(const char* filename);
 void logMove(const char* filename, Move* move);
 int computeMove(int userType, char* board, MoveSet* moves, int colorFlag, int evaluator);
 void sendKillSig();
+void playMove(char* board, Move* move);
 void enqueueMove(Move* move);
 int moveLoopDetected();
+char* setupPosition(const char* moveList, Move* prevMove, int* colorFlag);
+int verifySearch();
+int benchmarkSearch();
+void benchmarkCluster();
+void serveGame();
+int verifyMoveTree(char* board, int colorFlag, Move* prevMove, int depth, long* nodes);
+int sameMoves(MoveSet* moves, MoveSet* reference);
 
 /*
  * Main function.
  */
 int main(int argc, char* argv[])
 {	
-	//Initialize MPI
-	Init(argc, argv);
+	//Initialize MPI, only the main thread of each node makes MPI calls
+	Init_thread(argc, argv, MPI_THREAD_FUNNELED);
 	proc = COMM_WORLD.Get_rank();
 	numProcs = COMM_WORLD.Get_size();
+	initBitboards();
+	initSearch();
+	initTable(HASH_SIZE);
+	setSearchThreads(SEARCH_THREADS);
+	setNodeThreads(NODE_THREADS);
+	setSplitSearch(SPLIT_SEARCH);
+	setNullMovePruning(NULL_MOVE);
+	setMoveReductions(MOVE_REDUCTIONS);
 
-	//Require at least 1 slave node to run
-	if (numProcs < 2)
+	//Verify the search against plain minimax if requested
+	if (streq(argv[argc - 1], (char*) "-v"))
 	{
 		if (proc == HEAD)
-			printf("Program requires at least 1 slave node to run.\nTerminating.\n");
+			verifySearch();
+		Finalize();
+		return 0;
+	}
+
+	//Share the hosts' transposition tables over the cluster
+	initClusterTable();
+
+	//Compare search speed if requested: single and multithreaded on one
+	//node, or without and with the cluster table on several
+	if (streq(argv[argc - 1], (char*) "-b"))
+	{
+		if (numProcs == 1)
+			benchmarkSearch();
+		else if (proc == HEAD)
+			benchmarkCluster();
+		else
+			serveGame();
 		Finalize();
 		return 0;
 	}
@@ -113,8 +174,10 @@ int main(int argc, char* argv[])
 							move->pieceId = KING;
 						else
 							move->pieceId = KING + BLACK;
+					} else {
+						move->pieceId = getPieceAt(board, move->startRow, move->startCol);
 					}
-					executeMove(board, move, prev);
+					playMove(board, move);
 					free(move);
 					
 					//Switch players
@@ -220,36 +283,7 @@ int main(int argc, char* argv[])
 	} else {
 		//Slave node code
 		//======================================================================
-		int color;
-		int depth;
-		int evaluator;
-		char board[64];
-		while (TRUE)
-		{
-			//Receive data from HEAD node
-			COMM_WORLD.Recv(&color, 1, MPI_INT, HEAD, 0);
-			
-			//Terminate program if color is -1
-			if (color == -1)
-				break;
-			
-			COMM_WORLD.Recv(&depth, 1, MPI_INT, HEAD, 0);
-			COMM_WORLD.Recv(&evaluator, 1, MPI_INT, HEAD, 0);
-			COMM_WORLD.Recv(&board, 64, MPI_CHAR, HEAD, 0);
-			MoveSet* set = receiveMoveSet();
-			Move* prevMove = receiveMove();
-			
-			//Determine best move
-			MoveDef* bmd = bestMoveHelper(board, color, depth, set, prevMove, evaluator);
-			
-			//Send MoveDef back to head node
-			sendMoveDef(bmd);
-			
-			//Free memory
-			destroyMoveSet(set);
-			free(bmd);
-			free(prevMove);
-		}
+		serveGame();
 		//======================================================================
 	}
 	
@@ -258,16 +292,465 @@ int main(int argc, char* argv[])
 	return 0;
 }
 
+/*
+ * Slave node loop.  Keeps a copy of the game, updated with each move the
+ * head broadcasts, and searches root moves handed out by the head node
+ * until it sends the quit command.
+ */
+void serveGame()
+{
+	char* board = buildNewBoard();
+	Move* prevMove = newMove();
+	int command[COMMAND_SIZE];
+	int color;
+	long counts[3];
+	while (TRUE)
+	{
+		broadcastCommand(command);
+		if (command[0] == QUIT_COMMAND)
+			break;
+
+		if (command[0] == PLAY_COMMAND)
+		{
+			Move* move = constructMove((char) command[1], (char) command[2], (char) command[3], (char) command[4], (char) command[5], 0);
+			executeMove(board, move, prevMove);
+			free(prevMove);
+			prevMove = move;
+		} else if (command[0] == SETUP_COMMAND) {
+			//Start the benchmark position over, see benchmarkCluster()
+			free(board);
+			board = setupPosition(verifyPositions[command[1]], prevMove, &color);
+			clearSharedTable();
+			useClusterTable(command[2]);
+			clearClusterTable();
+		} else if (command[0] == COUNT_COMMAND) {
+			sumSearchCounts(counts);
+		} else {
+			//Search root moves handed out by the head node
+			Bitboard key = (unsigned int) command[4] | ((Bitboard) (unsigned int) command[5] << 32);
+			serveSearch(board, command[1], prevMove, command[2], command[3], key);
+		}
+	}
+
+	free(board);
+	free(prevMove);
+}
+
 /*
  * Sends a signal to other processors instructing
  * them to terminate execution.
  */
 void sendKillSig()
+{
+	int command[COMMAND_SIZE] = {QUIT_COMMAND};
+	broadcastCommand(command);
+}
+
+/*
+ * Execute a move on the head node's board, broadcast it so the slave
+ * nodes can play it on their copies, and make it the previous move.
+ */
+void playMove(char* board, Move* move)
+{
+	executeMove(board, move, prev);
+	broadcastMove(move);
+	free(prev);
+	prev = cloneMove(move);
+}
+
+/*
+ * Build a board by playing a space separated sequence of logged moves
+ * from the starting position.  The last move played is copied into
+ * prevMove and the color to move is stored in colorFlag.
+ */
+char* setupPosition(const char* moveList, Move* prevMove, int* colorFlag)
+{
+	int i, j;
+	char buffer[6];
+	char* board = buildNewBoard();
+	setWhiteCastleInvalid(FALSE);
+	setBlackCastleInvalid(FALSE);
+	*colorFlag = WHITE;
+
+	for (i = 0; moveList[i] != '\0'; )
+	{
+		//Read next move
+		for (j = 0; moveList[i] != ' ' && moveList[i] != '\0' && j < 4; i++, j++)
+			buffer[j] = moveList[i];
+		buffer[j] = '\0';
+		while (moveList[i] == ' ')
+			i++;
+
+		//Execute it
+		Move* move = strToMove(buffer);
+		if (move->startRow == CASTLE)
+		{
+			if (*colorFlag == WHITE)
+				move->pieceId = KING;
+			else
+				move->pieceId = KING + BLACK;
+		} else {
+			move->pieceId = getPieceAt(board, move->startRow, move->startCol);
+		}
+		executeMove(board, move, prevMove);
+		*prevMove = *move;
+		free(move);
+
+		//Switch players
+		if (*colorFlag == WHITE)
+			*colorFlag = BLACK;
+		else
+			*colorFlag = WHITE;
+	}
+
+	return board;
+}
+
+/*
+ * Run the alpha-beta search and plain minimax on each verification
+ * position and check that both find the same best-move value.  Null-move
+ * pruning and late move reductions are off for that check; a search with
+ * them is reported alongside.
+ * Returns the number of positions where they disagree.
+ */
+int verifySearch()
+{
+	int i, color;
+	int mismatches = 0;
+	long minimaxTotal = 0;
+	long alphaBetaTotal = 0;
+	long cutoffTotal = 0;
+	long firstCutoffTotal = 0;
+	long reducedTotal = 0;
+
+	//Check the move generator against the board scanning reference first
+	printf("VERIFYING MOVE GENERATION (DEPTH %d)\n", VERIFY_DEPTH);
+	for (i = 0; i < VERIFY_POSITIONS; i++)
+	{
+		long nodes = 0;
+		Move* prevMove = newMove();
+		char* board = setupPosition(verifyPositions[i], prevMove, &color);
+		int errors = verifyMoveTree(board, color, prevMove, VERIFY_DEPTH, &nodes);
+		printf("POSITION %d: %ld NODES %s\n", i + 1, nodes, errors == 0 ? "OK" : "MISMATCH");
+		if (errors != 0)
+			mismatches++;
+		free(prevMove);
+		free(board);
+	}
+
+	printf("VERIFYING ALPHA-BETA AGAINST MINIMAX (DEPTH %d)\n", VERIFY_DEPTH);
+	for (i = 0; i < VERIFY_POSITIONS; i++)
+	{
+		Move* prevMove = newMove();
+		char* board = setupPosition(verifyPositions[i], prevMove, &color);
+		MoveSet* moves = getLegalMoves(board, color, prevMove, VERIFY_FUNCTION);
+
+		//Plain minimax
+		setSearchPruning(FALSE);
+		resetSearchNodes();
+		MoveDef* minimax = bestMoveHelper(board, color, VERIFY_DEPTH, moves, prevMove, VERIFY_FUNCTION, -INFINITY, INFINITY);
+		long minimaxNodes = getSearchNodes();
+
+		//Alpha-beta, with an empty transposition table
+		setSearchPruning(TRUE);
+		setNullMovePruning(FALSE);
+		setMoveReductions(FALSE);
+		clearTable();
+		resetSearchNodes();
+		MoveDef* alphaBeta = bestMoveHelper(board, color, VERIFY_DEPTH, moves, prevMove, VERIFY_FUNCTION, -INFINITY, INFINITY);
+		long alphaBetaNodes = getSearchNodes();
+		long cutoffs, firstCutoffs;
+		getCutoffCounts(&cutoffs, &firstCutoffs);
+		cutoffTotal += cutoffs;
+		firstCutoffTotal += firstCutoffs;
+
+		//Alpha-beta with null-move pruning and late move reductions,
+		//which may change the value
+		setNullMovePruning(TRUE);
+		setMoveReductions(TRUE);
+		clearTable();
+		resetSearchNodes();
+		MoveDef* reduced = bestMoveHelper(board, color, VERIFY_DEPTH, moves, prevMove, VERIFY_FUNCTION, -INFINITY, INFINITY);
+		long reducedNodes = getSearchNodes();
+		setNullMovePruning(NULL_MOVE);
+		setMoveReductions(MOVE_REDUCTIONS);
+
+		printf("POSITION %d: MINIMAX %d (%ld NODES), ALPHA-BETA %d (%ld NODES) %s, REDUCED %d (%ld NODES)\n", i + 1,
+			minimax->value, minimaxNodes, alphaBeta->value, alphaBetaNodes,
+			minimax->value == alphaBeta->value ? "OK" : "MISMATCH", reduced->value, reducedNodes);
+		if (minimax->value != alphaBeta->value)
+			mismatches++;
+		minimaxTotal += minimaxNodes;
+		alphaBetaTotal += alphaBetaNodes;
+		reducedTotal += reducedNodes;
+
+		free(minimax);
+		free(alphaBeta);
+		free(reduced);
+		destroyMoveSet(moves);
+		free(prevMove);
+		free(board);
+	}
+
+	printf("TOTAL NODES: MINIMAX %ld, ALPHA-BETA %ld, REDUCED %ld\n", minimaxTotal, alphaBetaTotal, reducedTotal);
+	printf("ALPHA-BETA CUTOFFS: %ld, %.1f%% ON THE FIRST MOVE\n", cutoffTotal,
+		(cutoffTotal > 0) ? 100.0 * firstCutoffTotal / cutoffTotal : 0.0);
+	if (mismatches == 0)
+		printf("SEARCH VERIFIED.\n");
+	else
+		printf("SEARCH VERIFICATION FAILED: %d MISMATCHES.\n", mismatches);
+
+	//Restore castling state for normal play
+	setWhiteCastleInvalid(FALSE);
+	setBlackCastleInvalid(FALSE);
+	return mismatches;
+}
+
+/*
+ * Search each verification position at SEARCH_DEPTH with one thread, then
+ * with SEARCH_THREADS threads by Lazy SMP and by splitting the tree (YBW),
+ * starting from an empty transposition table each time, and report the
+ * time, nodes per second and speedup, and how often the one-thread search
+ * cut a node off on its first move.  A YBW search should find the same
+ * value as one thread; returns the number of positions where it did not.
+ */
+int benchmarkSearch()
+{
+	int i, color;
+	int mismatches = 0;
+	double singleTotal = 0;
+	double threadedTotal = 0;
+	double splitTotal = 0;
+	long cutoffTotal = 0;
+	long firstCutoffTotal = 0;
+
+	printf("BENCHMARKING SEARCH (DEPTH %d, 1 AND %d THREADS, LAZY SMP AND YBW)\n", SEARCH_DEPTH, SEARCH_THREADS);
+	for (i = 0; i < VERIFY_POSITIONS; i++)
+	{
+		Move* prevMove = newMove();
+		char* board = setupPosition(verifyPositions[i], prevMove, &color);
+		MoveSet* moves = getLegalMoves(board, color, prevMove, FUNCTION_BLACK);
+
+		clearTable();
+		resetSearchNodes();
+		double start = Wtime();
+		MoveDef* single = bestMoveThreaded(board, color, SEARCH_DEPTH, moves, prevMove, FUNCTION_BLACK, -INFINITY, INFINITY, 1);
+		double singleTime = Wtime() - start;
+		long singleNodes = getSearchNodes();
+		long cutoffs, firstCutoffs;
+		getCutoffCounts(&cutoffs, &firstCutoffs);
+		cutoffTotal += cutoffs;
+		firstCutoffTotal += firstCutoffs;
+
+		clearTable();
+		resetSearchNodes();
+		setSplitSearch(FALSE);
+		start = Wtime();
+		MoveDef* threaded = bestMoveThreaded(board, color, SEARCH_DEPTH, moves, prevMove, FUNCTION_BLACK, -INFINITY, INFINITY, SEARCH_THREADS);
+		double threadedTime = Wtime() - start;
+		long threadedNodes = getSearchNodes();
+
+		clearTable();
+		resetSearchNodes();
+		setSplitSearch(TRUE);
+		start = Wtime();
+		MoveDef* split = bestMoveThreaded(board, color, SEARCH_DEPTH, moves, prevMove, FUNCTION_BLACK, -INFINITY, INFINITY, SEARCH_THREADS);
+		double splitTime = Wtime() - start;
+		long splitNodes = getSearchNodes();
+		setSplitSearch(SPLIT_SEARCH);
+
+		printf("POSITION %d: 1 THREAD %.3fs (%.0f NPS), LAZY SMP %.3fs (%.0f NPS), YBW %.3fs (%.0f NPS)", i + 1,
+			singleTime, singleNodes / singleTime, threadedTime, threadedNodes / threadedTime,
+			splitTime, splitNodes / splitTime);
+		if (split->value != single->value)
+		{
+			printf(", YBW VALUE %d DIFFERS FROM %d", split->value, single->value);
+			mismatches++;
+		}
+		printf("\n");
+		singleTotal += singleTime;
+		threadedTotal += threadedTime;
+		splitTotal += splitTime;
+
+		free(single);
+		free(threaded);
+		free(split);
+		destroyMoveSet(moves);
+		free(prevMove);
+		free(board);
+	}
+
+	printf("TOTAL: 1 THREAD %.3fs, LAZY SMP %.3fs (SPEEDUP %.2f), YBW %.3fs (SPEEDUP %.2f)\n", singleTotal,
+		threadedTotal, singleTotal / threadedTotal, splitTotal, singleTotal / splitTotal);
+	printf("1 THREAD CUTOFFS: %ld, %.1f%% ON THE FIRST MOVE\n", cutoffTotal,
+		(cutoffTotal > 0) ? 100.0 * firstCutoffTotal / cutoffTotal : 0.0);
+	if (mismatches == 0)
+		printf("YBW VALUES MATCH 1 THREAD.\n");
+	else
+		printf("YBW VALUES DIFFER FROM 1 THREAD IN %d OF %d POSITIONS.\n", mismatches, VERIFY_POSITIONS);
+
+	//Restore castling state for normal play
+	setWhiteCastleInvalid(FALSE);
+	setBlackCastleInvalid(FALSE);
+	return mismatches;
+}
+
+/*
+ * Search the verification positions on every node, first with each node's
+ * own transposition table and then with the cluster table, and compare
+ * the nodes searched over the whole cluster.  Run on the head node while
+ * the slave nodes serve the game.
+ */
+void benchmarkCluster()
+{
+	int i, color, cluster;
+	long counts[3];
+	long nodes[2] = {0, 0};
+	double times[2] = {0, 0};
+	long probes = 0, hits = 0;
+	Move* prevMove = newMove();
+
+	printf("BENCHMARKING CLUSTER TABLE (DEPTH %d, %d NODES)\n", SEARCH_DEPTH, numProcs);
+	for (i = 0; i < VERIFY_POSITIONS; i++)
+	{
+		long positionNodes[2];
+		double positionTimes[2];
+		for (cluster = FALSE; cluster <= TRUE; cluster++)
+		{
+			//set up the position on every node, with empty tables
+			int command[COMMAND_SIZE] = {SETUP_COMMAND, i, cluster};
+			broadcastCommand(command);
+			char* board = setupPosition(verifyPositions[i], prevMove, &color);
+			clearSharedTable();
+			useClusterTable(cluster);
+			clearClusterTable();
+
+			double start = Wtime();
+			bestMove(board, color, prevMove, SEARCH_DEPTH, FUNCTION_BLACK);
+			positionTimes[cluster] = Wtime() - start;
+
+			int count[COMMAND_SIZE] = {COUNT_COMMAND};
+			broadcastCommand(count);
+			sumSearchCounts(counts);
+			positionNodes[cluster] = counts[0];
+			probes += counts[1];
+			hits += counts[2];
+
+			free(board);
+		}
+
+		printf("POSITION %d: LOCAL TABLES %ld NODES %.3fs, CLUSTER TABLE %ld NODES %.3fs, NODES SAVED %.1f%%\n", i + 1,
+			positionNodes[0], positionTimes[0], positionNodes[1], positionTimes[1],
+			100.0 * (positionNodes[0] - positionNodes[1]) / positionNodes[0]);
+		for (cluster = FALSE; cluster <= TRUE; cluster++)
+		{
+			nodes[cluster] += positionNodes[cluster];
+			times[cluster] += positionTimes[cluster];
+		}
+	}
+
+	printf("TOTAL: LOCAL TABLES %ld NODES %.3fs, CLUSTER TABLE %ld NODES %.3fs, NODES SAVED %.1f%%\n",
+		nodes[0], times[0], nodes[1], times[1], 100.0 * (nodes[0] - nodes[1]) / nodes[0]);
+	printf("REMOTE PROBES %ld, FOUND %.1f%%\n", probes, probes > 0 ? 100.0 * hits / probes : 0.0);
+	sendKillSig();
+	free(prevMove);
+
+	//Restore castling state for normal play
+	setWhiteCastleInvalid(FALSE);
+	setBlackCastleInvalid(FALSE);
+}
+
+/*
+ * Compare getLegalMoves() with the board scanning reference generator at
+ * every node of the tree below a position, and check each move's score
+ * against the reference evaluation of the board after the move.  Also
+ * checks that making and taking back each move keeps the Zobrist key
+ * equal to a full recompute.
+ * Returns the number of disagreements found.
+ */
+int verifyMoveTree(char* board, int colorFlag, Move* prevMove, int depth, long* nodes)
 {
 	int i;
-	int sig = -1;
-	for (i = 1; i < numProcs; i++) 
-		COMM_WORLD.Send(&sig, 1, MPI_INT, i, 0);
+	int errors = 0;
+	MoveSet* moves = getLegalMoves(board, colorFlag, prevMove, VERIFY_FUNCTION);
+	MoveSet* reference = getLegalMovesScan(board, colorFlag, prevMove, VERIFY_FUNCTION);
+	(*nodes)++;
+
+	if (!sameMoves(moves, reference))
+	{
+		printBoard(board);
+		printf("GENERATED:\n");
+		printMoves(moves);
+		printf("REFERENCE:\n");
+		printMoves(reference);
+		errors++;
+	}
+
+	char castleFlags = getCastleFlags();
+	char* next = buildNewBoard();
+	Position pos;
+	UndoRecord undo;
+	loadPosition(board, colorFlag, prevMove, &pos);
+	Bitboard key = pos.key;
+	for (i = 0; i < moves->size; i++)
+	{
+		Move* move = getMove(moves, i);
+		executeMove(&pos, move, &undo);
+		if (pos.key != computeKey(&pos))
+		{
+			printMove(move);
+			printf("KEY %llx, RECOMPUTED %llx\n", pos.key, computeKey(&pos));
+			errors++;
+		}
+		undoMove(&pos, move, &undo);
+		if (pos.key != key)
+		{
+			printMove(move);
+			printf("KEY NOT RESTORED BY UNDO\n");
+			errors++;
+		}
+
+		cloneBoard(board, next);
+		executeMove(next, move, prevMove);
+		if (move->boardScore != evaluateBoardScan(next, VERIFY_FUNCTION))
+		{
+			printMove(move);
+			printf("SCORE %d, REFERENCE %d\n", move->boardScore, evaluateBoardScan(next, VERIFY_FUNCTION));
+			errors++;
+		}
+		if (depth > 1)
+			errors += verifyMoveTree(next, colorFlag == WHITE ? BLACK : WHITE, move, depth - 1, nodes);
+		setCastleFlags(castleFlags);
+	}
+
+	free(next);
+	destroyMoveSet(moves);
+	destroyMoveSet(reference);
+	return errors;
+}
+
+/*
+ * Returns TRUE if two move sets hold the same moves, in any order.
+ */
+int sameMoves(MoveSet* moves, MoveSet* reference)
+{
+	int i, j;
+	if (moves->size != reference->size)
+		return FALSE;
+
+	for (i = 0; i < moves->size; i++)
+	{
+		Move* move = getMove(moves, i);
+		for (j = 0; j < reference->size; j++)
+		{
+			Move* ref = getMove(reference, j);
+			if (movesEqual(move, ref) && move->pieceId == ref->pieceId)
+				break;
+		}
+		if (j == reference->size)
+			return FALSE;
+	}
+	return TRUE;
 }
 
 /*
@@ -420,12 +903,8 @@ int computeMove(int userType, char* board, MoveSet* moves, int colorFlag, int ev
 		}
 		srand((unsigned int) time(NULL));
 		
-		//execute move
-		executeMove(board, move, prev);
-		
-		//set previous move to current
-		free(prev);
-		prev = cloneMove(move);
+		//execute move, it becomes the previous move
+		playMove(board, move);
 		
 		//print output
 		printBoard(board);
@@ -437,13 +916,16 @@ int computeMove(int userType, char* board, MoveSet* moves, int colorFlag, int ev
 		//AI move
 		Move* best;
 		
-		//determine best move, increase search depth if fewer pieces on board
-		if (totalPieces(board) > 9)
-			best = bestMove(board, colorFlag, prev, SEARCH_DEPTH, evaluator);
-		else if (totalPieces(board) > 5)
-			best = bestMove(board, colorFlag, prev, SEARCH_DEPTH + 1, evaluator);
-		else
-			best = bestMove(board, colorFlag, prev, SEARCH_DEPTH + 2, evaluator);
+		//determine best move by iterative deepening within the move's budget,
+		//without one increase search depth if fewer pieces on board
+		int depth = SEARCH_DEPTH;
+		if (MOVE_TIME > 0 || MOVE_NODES > 0)
+			depth = MAX_DEPTH;
+		else if (totalPieces(board) <= 5)
+			depth = SEARCH_DEPTH + 2;
+		else if (totalPieces(board) <= 9)
+			depth = SEARCH_DEPTH + 1;
+		best = bestMoveIterative(board, colorFlag, prev, depth, MOVE_TIME, MOVE_NODES, evaluator);
 		
 		if (best == NULL)
 		{
@@ -454,12 +936,8 @@ int computeMove(int userType, char* board, MoveSet* moves, int colorFlag, int ev
 			free(board);
 			return 0;
 		} else {
-			//execute best move
-			executeMove(board, best, prev);
-			
-			//set previous move to current
-			free(prev);
-			prev = cloneMove(best);
+			//execute best move, it becomes the previous move
+			playMove(board, best);
 			
 			//print output
 			printBoard(board);
@@ -7,11 +7,15 @@
 /* Includes */
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
 #include <mpi.h>
 #include "stddef.h"
 #include "strutil.h"
 #include "boardutil.h"
+#include "bitboard.h"
 #include "moves.h"
+#include "ttable.h"
 #include <mpi.h>
 
 using namespace MPI;
@@ -22,8 +26,258 @@ static char whiteQCastleInvalid = FALSE;
 static char blackKCastleInvalid = FALSE;
 static char blackQCastleInvalid = FALSE;
 
+//Search settings and statistics
+static char pruningEnabled = TRUE;
+static char nullMoveEnabled = TRUE;
+static char reductionsEnabled = TRUE;
+static long searchNodes = 0;
+static long searchCutoffs = 0;	//nodes cut off by a move that failed high
+static long firstCutoffs = 0;	//of those, cut off by the first move searched
+
+//Evaluator of the current search, salting its transposition table keys
+static int tableEvaluator = -1;
+
+//Search state of the calling thread, and the number of search threads
+static SearchContext mainContext;
+static int searchThreads = 1;
+static int nodeThreads = 1;	//search threads on each node of a search spread over the nodes
+static char splitSearch = FALSE;	//threads split the tree (YBW) instead of Lazy SMP
+
+//Root work queue for a search spread over the nodes, see bestMove().
+//Work is handed out in units: a root move, or a root move and one of the
+//opponent's replies when the root is split at ply 2.  Once none are
+//left, nodes steal moves from the split points of nodes still searching.
+#define STEALING -1	//job of a node sent to steal a split point's move
+typedef struct
+{
+	MoveSet* legalMoves;
+	int color;
+	int depth;
+	int units;	//work units in the queue
+	int* unitMove;	//root move of each unit
+	int* unitReply;	//reply of each unit, or -1 for the whole root move
+	int* movePending;	//units of each root move not yet finished
+	int* moveValue;	//value of each root move over its finished units
+	char* moveDropped;	//set once units of a root move are skipped or cancelled
+	int next;	//next unit to hand out
+	int active;	//slave nodes searching a unit or a stolen move
+	int* jobs;	//unit each node is searching, or STEALING
+	char* cancelled;	//whether each node's job was cancelled
+	Request* requests;	//receive posted for each node's result
+	int (*results)[RESULT_SIZE];	//result buffer for each node
+	double* sent;	//when each node's job was handed out
+	double* busy;	//total time each node spent searching
+	MoveDef best;	//best root move so far
+	int headJob;	//unit the head node is searching
+	volatile char headStop;	//set when the head node's job is cancelled
+	RootWindow headWindow;	//window of the head node's job
+	struct SearchBudget* budget;	//budget the search stops at, or NULL
+	int victim;	//node last sent a thief, see stealVictim()
+	int steals;	//split point moves stolen by nodes with no unit left
+} RootQueue;
+
+//Job being searched by a slave node, see serveSearch()
+typedef struct
+{
+	int unit;
+	int index;	//root move
+	int color;
+	volatile char stop;	//set when the head node cancels the job
+	RootWindow window;
+} SlaveJob;
+
+//Move ordering below the root, see orderMoves(): the transposition
+//table's move, then captures and promotions, then the two killer moves,
+//then the other quiet moves by history score
+#define HASH_ORDER (1 << 30)
+#define CAPTURE_ORDER (1 << 29)
+#define KILLER_ORDER (1 << 28)
+#define HISTORY_MAX (1 << 20)	//history scores are halved once one reaches this
+static const int orderRanks[7] = {0, 1, 4, 2, 3, 5, 6};	//EMPTY, PAWN, ROOK, KNIGHT, BISHOP, QUEEN, KING by value
+
+//Null-move pruning, see nullMoveSafe()
+#define NULL_REDUCTION 2	//plies the search after a null move is reduced by, besides the null move itself
+#define NULL_MIN_DEPTH 2	//nodes closer to the leaves do not try a null move
+#define MATE_BOUND (CHECKMATE_VALUE / 2)	//scores at least this far from 0 are mates
+
+//Late move reductions: quiet moves searched after the first LMR_MIN_MOVES
+//at nodes at least LMR_MIN_DEPTH from the leaves are searched shallower,
+//by reductions[depth][move index], see initSearch()
+#define LMR_MIN_DEPTH 3
+#define LMR_MIN_MOVES 3
+static char reductions[MAX_PLY][MAX_MOVES];
+
+//Budget of an iterative deepening search, see bestMoveIterative()
+typedef struct SearchBudget
+{
+	double deadline;	//Wtime() to stop at, or 0 for no limit
+	long nodeLimit;	//nodes to stop at, or 0 for no limit
+	long slaveNodes;	//nodes searched by the slave nodes, counted as their jobs finish
+	char armed;	//FALSE while the first search runs, which always finishes
+	volatile char stop;	//set once the budget has run out
+} SearchBudget;
+
+//How the nodes spent one move's searches spread over them, see searchMoves()
+typedef struct
+{
+	double elapsed;	//time the searches took
+	double* busy;	//time each node spent searching units, by node
+	int searches;
+	int splits;	//searches split at ply 2
+	int steals;	//moves taken from split points of other nodes
+} IdleReport;
+static IdleReport idleReport = {0, NULL, 0, 0, 0};
+
+//Helper thread for bestMoveThreaded()
+typedef struct
+{
+	SearchContext context;
+	Position pos;
+	MoveSet* moves;	//root moves, in this helper's order
+	int color;
+	int depth;	//first depth searched
+	int evaluator;
+	pthread_t thread;
+} HelperJob;
+
+//Young Brothers Wait split point: a node whose first move has been
+//searched, with the remaining moves shared out to idle threads
+#define SPLIT_DEPTH 2	//nodes closer to the leaves are searched by one thread
+typedef struct SplitPoint
+{
+	pthread_mutex_t lock;
+	struct SplitPoint* parent;	//split point the owner was searching under, or NULL
+	volatile char* stop;	//the owner's stop flag, or NULL
+	Position pos;
+	int color;
+	int depth;
+	int evaluator;
+	int ply;
+	MoveSet* moves;	//the node's moves, owned by the owner's search
+	int next;	//next move to hand out
+	int working;	//moves being searched
+	int alpha;
+	int beta;
+	int best;
+	int bestIndex;
+	volatile char cutoff;	//set once a move fails high, ending the node
+} SplitPoint;
+
+//Threads of a YBW search, each with a deque of the split points it owns,
+//oldest first.  Idle threads steal moves from the oldest split points, and
+//so do other nodes, see serveSteals().
+#define MAX_WORKERS 64
+typedef struct
+{
+	pthread_mutex_t lock;	//guards every deque
+	int workers;
+	SplitPoint* deques[MAX_WORKERS][MAX_PLY];
+	int dequeSizes[MAX_WORKERS];
+	volatile char stop;	//set when the search is over
+} SplitPool;
+static SplitPool splitPool;
+
+//Worker thread for bestMoveSplit()
+typedef struct
+{
+	SearchContext context;
+	pthread_t thread;
+} SplitWorker;
+
+//Split points also hand moves to other nodes, see serveSteals(): a
+//thief node asks for a move, and is sent the split point's position and
+//the move with its window, or nothing.  It sends the move's value back.
+#define REMOTE_SPLIT_DEPTH 3	//moves of split points closer to the leaves stay on the node
+#define STEAL_REQUEST 1	//to the victim: hand over a move
+#define STEAL_RESULT 2	//to the victim: the value of a stolen move
+#define STEAL_NONE 3	//to the thief: nothing to steal
+#define STEAL_MOVE 4	//to the thief: a move to search
+#define STEAL_CANCEL 5	//to the thief: stop, the move's split point was cut off
+typedef struct
+{
+	int type;
+	int steal;	//the thief's number for the request, to match cancels with
+	int value;
+	int color;	//side to move at the split point
+	int depth;	//of the split point
+	int ply;
+	int evaluator;
+	int index;	//of the move, in the split point's ordering
+	int alpha;
+	int beta;
+	Move move;
+	Position pos;	//of the split point
+} StealMessage;
+
+//Move of one of this node's split points stolen by another node
+typedef struct
+{
+	SplitPoint* sp;	//NULL if the thief has none
+	int index;
+	int steal;
+	char cancelled;	//set once the thief has been told to stop
+} RemoteMove;
+static RemoteMove* remoteMoves = NULL;	//by thief node, allocated on first use
+static int stealCount = 0;	//steal requests this node has sent
+
+//Move this node stole from another node, see stealRemoteMove()
+typedef struct
+{
+	int victim;
+	int steal;
+	volatile char stop;	//set when the victim cancels it
+} StolenMove;
+
+static void generateMoves(Position* pos, int color, int evaluator, MoveSet* moves, char capturesOnly);
+static void useEvaluator(int evaluator);
+static void collectCounts(SearchContext* ctx);
+static char splitCut(SplitPoint* sp);
+static void foldSplitValue(SplitPoint* sp, int index, int value);
+static int splitNode(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* legalMoves, int evaluator, int alpha, int beta, int ply, int best, int* bestIndex);
+static MoveDef* bestMoveSplit(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta, int threads);
+static SplitWorker* startSplitPool(int threads);
+static void stopSplitPool(SplitWorker* workers);
+static void serveSteals();
+static void waitMessage(int source, int tag);
+static char stealRemoteMove(int victim);
+static MoveDef* searchMoves(char* board, int color, Move* prevMove, int depth, MoveSet* legalMoves, int evaluator, int first, SearchBudget* budget);
+static void pollBudget(void* data);
+static void printIdleReport();
+static MoveDef* searchRoot(SearchContext* ctx, char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta);
+static int searchPosition(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* legalMoves, int evaluator, int alpha, int beta, int ply, int* bestIndex);
+static int quiesce(SearchContext* ctx, Position* pos, int color, int evaluator, int alpha, int beta, int ply);
+static int zeroWindow(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* legalMoves, int evaluator, int alpha, int beta, int ply);
+static int searchLaterMove(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* nextLegal, int evaluator, int alpha, int beta, int ply, Move* move, int index, char quiet, char inCheck);
+static int searchReply(char* board, int color, Move* prevMove, int depth, MoveSet* legalMoves, int index, int reply, int evaluator, int alpha, int beta);
+
 /*	Returns TRUE or FALSE if king of a given color is in check. */
 char kingInCheck(char* board, char color)
+{
+	Position pos;
+	boardToPosition(board, &pos);
+	return positionInCheck(&pos, color);
+}
+
+/*
+ * Determine if a piece is safe, i.e. not attacked by the other color.
+ */
+char pieceSafe(char* board, int row, int col)
+{
+	Position pos;
+	char p = getPieceAt(board, row, col);
+	if (p == EMPTY)
+		return TRUE;
+
+	boardToPosition(board, &pos);
+	if (isWhite(p))
+		return !squareAttacked(&pos, SQUARE(row, col), BLACK);
+	else
+		return !squareAttacked(&pos, SQUARE(row, col), WHITE);
+}
+
+/*	Returns TRUE or FALSE if king of a given color is in check, scanning the
+	board square by square.  Reference for kingInCheck(). */
+char kingInCheckScan(char* board, char color)
 {
 	int i, j, row, col;
 	if (color == WHITE)
@@ -41,7 +295,7 @@ char kingInCheck(char* board, char color)
 			}
 		}
 
-		return !pieceSafe(board, row, col);
+		return !pieceSafeScan(board, row, col);
 	} else {
 		//Find black king
 		for (i = 0; i < 8; i++)
@@ -56,14 +310,15 @@ char kingInCheck(char* board, char color)
 			}
 		}
 
-		return !pieceSafe(board, row, col);
+		return !pieceSafeScan(board, row, col);
 	}
 }
 
 /*
- * Determine if a piece is safe.
+ * Determine if a piece is safe by walking each ray from its square.
+ * Reference for pieceSafe().
  */
-char pieceSafe(char* board, int row, int col)
+char pieceSafeScan(char* board, int row, int col)
 {
 	int i, j;
 	if (isWhite(getPieceAt(board, row, col)))
@@ -74,7 +329,7 @@ char pieceSafe(char* board, int row, int col)
 			getPieceAt(board, row + 1, col - 1) == PAWN + BLACK)
 			return FALSE;
 		if (row + 1 < 8 && col + 1 < 8 &&
-			getPieceAt(board, row + 1, col - 1) == PAWN + BLACK)
+			getPieceAt(board, row + 1, col + 1) == PAWN + BLACK)
 			return FALSE;
 
 		//Check general diagonals (bishop / queen / king)
@@ -692,7 +947,7 @@ char spaceSafe(char* board, char color, int row, int col)
 			else
 				p = BLACK + PAWN;
 			setPieceAt(board, row, col, p);
-			if (pieceSafe(board, row, col))
+			if (pieceSafeScan(board, row, col))
 			{
 				setPieceAt(board, row, col, EMPTY);
 				return TRUE;
@@ -705,9 +960,10 @@ char spaceSafe(char* board, char color, int row, int col)
 }
 
 /*
- * Get legal moves.
+ * Get legal moves by scanning the board square by square.  This is the
+ * original generator, kept as a reference for getLegalMoves().
  */
-MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
+MoveSet* getLegalMovesScan(char* board, int color, Move* prevMove, int evaluator)
 {
 	int i, j, y, x;
 	int size = 20;
@@ -736,8 +992,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, i + 1, j, p);
 								setPieceAt(tmpBoard, i, j, EMPTY);
-								if (!kingInCheck(tmpBoard, WHITE))
-									addMove(moves, p, i, j, i + 1, j, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, WHITE))
+									addMove(moves, p, i, j, i + 1, j, evaluateBoardScan(tmpBoard, evaluator));
 							}
 
 							//try moving diagonally
@@ -746,8 +1002,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, i + 1, j + 1, p);
 								setPieceAt(tmpBoard, i, j, EMPTY);
-								if (!kingInCheck(tmpBoard, WHITE))
-									addMove(moves, p, i, j, i + 1, j + 1, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, WHITE))
+									addMove(moves, p, i, j, i + 1, j + 1, evaluateBoardScan(tmpBoard, evaluator));
 							}
 
 							cloneBoard(board, tmpBoard);
@@ -755,8 +1011,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, i + 1, j - 1, p);
 								setPieceAt(tmpBoard, i, j, EMPTY);
-								if (!kingInCheck(tmpBoard, WHITE))
-									addMove(moves, p, i, j, i + 1, j - 1, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, WHITE))
+									addMove(moves, p, i, j, i + 1, j - 1, evaluateBoardScan(tmpBoard, evaluator));
 							}
 
 							//try moving 2 spaces forward
@@ -766,8 +1022,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, 3, j, p);
 								setPieceAt(tmpBoard, 1, j, EMPTY);
-								if (!kingInCheck(tmpBoard, WHITE))
-									addMove(moves, p, 1, j, 3, j, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, WHITE))
+									addMove(moves, p, 1, j, 3, j, evaluateBoardScan(tmpBoard, evaluator));
 							}
 							
 							//check for en passant
@@ -780,16 +1036,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									setPieceAt(tmpBoard, 5, j - 1, p);		//move current pawn
 									setPieceAt(tmpBoard, 4, j, EMPTY);		//empty current space
 									setPieceAt(tmpBoard, 4, j - 1, EMPTY);	//capture enemy pawn
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, 4, j, 5, j - 1, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, 4, j, 5, j - 1, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (prevMove->endRow == 4 && prevMove->startRow == 6 && 
 									prevMove->endCol == j + 1 && prevMove->pieceId == PAWN + BLACK) {
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, 5, j + 1, p);		//move current pawn
 									setPieceAt(tmpBoard, 4, j, EMPTY);		//empty current space
 									setPieceAt(tmpBoard, 4, j + 1, EMPTY);	//capture enemy pawn
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, 4, j, 5, j + 1, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, 4, j, 5, j + 1, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							break;
@@ -803,16 +1059,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -826,16 +1082,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -849,16 +1105,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -872,16 +1128,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -899,8 +1155,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -915,8 +1171,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -931,8 +1187,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -947,8 +1203,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -963,8 +1219,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -979,8 +1235,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -995,8 +1251,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1011,8 +1267,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1027,16 +1283,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1050,16 +1306,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1073,16 +1329,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1096,16 +1352,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1121,16 +1377,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1144,16 +1400,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1167,16 +1423,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1190,16 +1446,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (!isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1213,16 +1469,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1236,16 +1492,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1259,16 +1515,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1282,16 +1538,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, WHITE))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, WHITE))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1310,14 +1566,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1333,14 +1589,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1356,14 +1612,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1379,14 +1635,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1402,14 +1658,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1425,14 +1681,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1448,14 +1704,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1471,43 +1727,45 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							
 							//king side castle
 							if (whiteKCastleInvalid == FALSE)
 							{
+								cloneBoard(board, tmpBoard);
 								if (spaceSafe(board, WHITE, 0, 5) == TRUE && spaceSafe(board, WHITE, 0, 6) == TRUE &&
-									getPieceAt(tmpBoard, 0, 4) == KING && getPieceAt(tmpBoard, 0, 7) == ROOK)
+									getPieceAt(board, 0, 4) == KING && getPieceAt(board, 0, 7) == ROOK)
 								{
 									setPieceAt(tmpBoard, 0, 4, EMPTY);
 									setPieceAt(tmpBoard, 0, 7, EMPTY);
 									setPieceAt(tmpBoard, 0, 6, KING);
 									setPieceAt(tmpBoard, 0, 5, ROOK);
-									addMove(moves, p, CASTLE, CASTLE, KINGSIDE, KINGSIDE, evaluateBoard(tmpBoard, evaluator));
+									addMove(moves, p, CASTLE, CASTLE, KINGSIDE, KINGSIDE, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							
 							//queen side castle
 							if (whiteQCastleInvalid == FALSE)
 							{
+								cloneBoard(board, tmpBoard);
 								if (spaceSafe(board, WHITE, 0, 1) == TRUE && spaceSafe(board, WHITE, 0, 2) == TRUE &&
-										spaceSafe(board, WHITE, 0, 3) && getPieceAt(tmpBoard, 0, 0) == ROOK &&
-										getPieceAt(tmpBoard, 0, 4) == KING)
+										spaceSafe(board, WHITE, 0, 3) && getPieceAt(board, 0, 0) == ROOK &&
+										getPieceAt(board, 0, 4) == KING)
 								{
 									setPieceAt(tmpBoard, 0, 0, EMPTY);
 									setPieceAt(tmpBoard, 0, 4, EMPTY);
 									setPieceAt(tmpBoard, 0, 2, KING);
 									setPieceAt(tmpBoard, 0, 3, ROOK);
-									addMove(moves, p, CASTLE, CASTLE, QUEENSIDE, QUEENSIDE, evaluateBoard(tmpBoard, evaluator));
+									addMove(moves, p, CASTLE, CASTLE, QUEENSIDE, QUEENSIDE, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							break;
@@ -1526,8 +1784,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, i - 1, j, p);
 								setPieceAt(tmpBoard, i, j, EMPTY);
-								if (!kingInCheck(tmpBoard, BLACK))
-									addMove(moves, p, i, j, i - 1, j, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, BLACK))
+									addMove(moves, p, i, j, i - 1, j, evaluateBoardScan(tmpBoard, evaluator));
 							}
 
 							//try moving diagonally
@@ -1536,8 +1794,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, i - 1, j + 1, p);
 								setPieceAt(tmpBoard, i, j, EMPTY);
-								if (!kingInCheck(tmpBoard, BLACK))
-									addMove(moves, p, i, j, i - 1, j + 1, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, BLACK))
+									addMove(moves, p, i, j, i - 1, j + 1, evaluateBoardScan(tmpBoard, evaluator));
 							}
 
 							cloneBoard(board, tmpBoard);
@@ -1545,8 +1803,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, i - 1, j - 1, p);
 								setPieceAt(tmpBoard, i, j, EMPTY);
-								if (!kingInCheck(tmpBoard, BLACK))
-									addMove(moves, p, i, j, i - 1, j - 1, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, BLACK))
+									addMove(moves, p, i, j, i - 1, j - 1, evaluateBoardScan(tmpBoard, evaluator));
 							}
 
 							//try moving 2 spaces forward
@@ -1556,8 +1814,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 							{
 								setPieceAt(tmpBoard, 4, j, p);
 								setPieceAt(tmpBoard, 6, j, EMPTY);
-								if (!kingInCheck(tmpBoard, BLACK))
-									addMove(moves, p, 6, j, 4, j, evaluateBoard(tmpBoard, evaluator));
+								if (!kingInCheckScan(tmpBoard, BLACK))
+									addMove(moves, p, 6, j, 4, j, evaluateBoardScan(tmpBoard, evaluator));
 							}
 							
 							//check for en passant
@@ -1570,16 +1828,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									setPieceAt(tmpBoard, 2, j - 1, p);		//move current pawn
 									setPieceAt(tmpBoard, 3, j, EMPTY);		//empty current space
 									setPieceAt(tmpBoard, 3, j - 1, EMPTY);	//capture enemy pawn
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, 3, j, 2, j - 1, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, 3, j, 2, j - 1, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (prevMove->endRow == 3 && prevMove->startRow == 1 && 
 										   prevMove->endCol == j + 1 && prevMove->pieceId == PAWN) {
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, 2, j + 1, p);		//move current pawn
 									setPieceAt(tmpBoard, 3, j, EMPTY);		//empty current space
 									setPieceAt(tmpBoard, 3, j + 1, EMPTY);	//capture enemy pawn
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, 3, j, 2, j + 1, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, 3, j, 2, j + 1, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							break;
@@ -1593,16 +1851,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1616,16 +1874,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1639,16 +1897,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1662,16 +1920,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1689,8 +1947,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1705,8 +1963,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1721,8 +1979,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1737,8 +1995,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1753,8 +2011,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1769,8 +2027,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1785,8 +2043,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -1801,8 +2059,8 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									cloneBoard(board, tmpBoard);
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							break;
@@ -1816,16 +2074,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1839,16 +2097,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1862,16 +2120,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1885,16 +2143,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1910,16 +2168,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y - 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1933,16 +2191,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, j, p);
 									setPieceAt(tmpBoard, y + 1, j, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, j, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, j, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1956,16 +2214,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -1979,16 +2237,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, i, x, p);
 									setPieceAt(tmpBoard, i, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, i, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, i, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -2002,16 +2260,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -2025,16 +2283,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y - 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -2048,16 +2306,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x + 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -2071,16 +2329,16 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 								{
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isBlack(t)) {
 									break;	//collided with piece on same team
 								} else {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, y + 1, x - 1, EMPTY);
-									if (!kingInCheck(tmpBoard, BLACK))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (!kingInCheckScan(tmpBoard, BLACK))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 									break;
 								}
 							}
@@ -2099,14 +2357,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -2122,14 +2380,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -2145,14 +2403,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -2168,14 +2426,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -2191,14 +2449,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -2214,14 +2472,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -2237,14 +2495,14 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 
@@ -2260,43 +2518,45 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 									//empty space
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								} else if (isWhite(t)) {
 									//this is an enemy piece, capture it
 									setPieceAt(tmpBoard, y, x, p);
 									setPieceAt(tmpBoard, i, j, EMPTY);
-									if (pieceSafe(tmpBoard, y, x))
-										addMove(moves, p, i, j, y, x, evaluateBoard(tmpBoard, evaluator));
+									if (pieceSafeScan(tmpBoard, y, x))
+										addMove(moves, p, i, j, y, x, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							
 							//king side castle
 							if (blackKCastleInvalid == FALSE)
 							{
+								cloneBoard(board, tmpBoard);
 								if (spaceSafe(board, BLACK, 7, 5) == TRUE && spaceSafe(board, BLACK, 7, 6) == TRUE &&
-									getPieceAt(tmpBoard, 7, 4) == BLACK + KING && getPieceAt(tmpBoard, 7, 7) == BLACK + KING)
+									getPieceAt(board, 7, 4) == BLACK + KING && getPieceAt(board, 7, 7) == BLACK + ROOK)
 								{
 									setPieceAt(tmpBoard, 7, 4, EMPTY);
 									setPieceAt(tmpBoard, 7, 7, EMPTY);
 									setPieceAt(tmpBoard, 7, 6, BLACK + KING);
 									setPieceAt(tmpBoard, 7, 5, BLACK + ROOK);
-									addMove(moves, p, CASTLE, CASTLE, KINGSIDE, KINGSIDE, evaluateBoard(tmpBoard, evaluator));
+									addMove(moves, p, CASTLE, CASTLE, KINGSIDE, KINGSIDE, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							
 							//queen side castle
 							if (blackQCastleInvalid == FALSE)
 							{
+								cloneBoard(board, tmpBoard);
 								if (spaceSafe(board, BLACK, 7, 1) == TRUE && spaceSafe(board, BLACK, 7, 2) == TRUE &&
-									spaceSafe(board, BLACK, 7, 3) && getPieceAt(tmpBoard, 7, 0) == BLACK + ROOK &&
-									getPieceAt(tmpBoard, 7, 4) == BLACK + KING)
+									spaceSafe(board, BLACK, 7, 3) && getPieceAt(board, 7, 0) == BLACK + ROOK &&
+									getPieceAt(board, 7, 4) == BLACK + KING)
 								{
 									setPieceAt(tmpBoard, 7, 0, EMPTY);
 									setPieceAt(tmpBoard, 7, 4, EMPTY);
 									setPieceAt(tmpBoard, 7, 2, BLACK + KING);
 									setPieceAt(tmpBoard, 7, 3, BLACK + ROOK);
-									addMove(moves, p, CASTLE, CASTLE, QUEENSIDE, QUEENSIDE, evaluateBoard(tmpBoard, evaluator));
+									addMove(moves, p, CASTLE, CASTLE, QUEENSIDE, QUEENSIDE, evaluateBoardScan(tmpBoard, evaluator));
 								}
 							}
 							break;
@@ -2310,6 +2570,258 @@ MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
 	return moves;
 }
 
+/*
+ * Get legal moves.
+ */
+MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator)
+{
+	Position pos;
+	loadPosition(board, color, prevMove, &pos);
+	MoveSet* moves = newMoveSet();
+	generateLegalMoves(&pos, color, evaluator, moves);
+	return moves;
+}
+
+/*
+ * Score of the position after a move, found by making the move and taking
+ * it back.  Returns 0 for the UNSCORED evaluator.
+ */
+int evaluateMove(Position* pos, Move* move, int evaluator)
+{
+	if (evaluator == UNSCORED)
+		return 0;
+
+	UndoRecord undo;
+	executeMove(pos, move, &undo);
+	int score = evaluatePosition(pos, evaluator);
+	undoMove(pos, move, &undo);
+	return score;
+}
+
+/*
+ * Add a move already known to be legal, scored unless the evaluator is
+ * UNSCORED.
+ */
+static void addLegal(Position* pos, int from, int to, int evaluator, MoveSet* moves)
+{
+	Move move;
+	move.pieceId = pos->mailbox[from];
+	move.startRow = (char) ROW_OF(from);
+	move.startCol = (char) COL_OF(from);
+	move.endRow = (char) ROW_OF(to);
+	move.endCol = (char) COL_OF(to);
+
+	addMove(moves, move.pieceId, move.startRow, move.startCol, move.endRow, move.endCol, evaluateMove(pos, &move, evaluator));
+}
+
+/*
+ * Try a move on the position and add it to the set if it does not leave
+ * the mover's king in check.  The position is restored before returning.
+ * Only needed for en passant, which can expose the king along the row
+ * both pawns leave.
+ */
+static void addIfLegal(Position* pos, int color, int from, int to, int evaluator, MoveSet* moves)
+{
+	UndoRecord undo;
+	Move move;
+	move.pieceId = pos->mailbox[from];
+	move.startRow = (char) ROW_OF(from);
+	move.startCol = (char) COL_OF(from);
+	move.endRow = (char) ROW_OF(to);
+	move.endCol = (char) COL_OF(to);
+
+	executeMove(pos, &move, &undo);
+	char legal = !positionInCheck(pos, color);
+	undoMove(pos, &move, &undo);
+	if (legal)
+		addMove(moves, move.pieceId, move.startRow, move.startCol, move.endRow, move.endCol, evaluateMove(pos, &move, evaluator));
+}
+
+/*
+ * Add a castling move if the king and rook are in place and the squares
+ * between them are empty and not attacked.  rookCol is 7 for kingside
+ * and 0 for queenside.
+ */
+static void addCastle(Position* pos, int color, int rookCol, int evaluator, MoveSet* moves)
+{
+	int row = (color == WHITE) ? 0 : 7;
+	int enemy = (color == WHITE) ? BLACK : WHITE;
+	int first = (rookCol == 7) ? 5 : 1;
+	int last = (rookCol == 7) ? 6 : 3;
+	int col;
+
+	if (pos->mailbox[SQUARE(row, 4)] != KING + color || pos->mailbox[SQUARE(row, rookCol)] != ROOK + color)
+		return;
+	for (col = first; col <= last; col++)
+	{
+		if (pos->mailbox[SQUARE(row, col)] != EMPTY || squareAttacked(pos, SQUARE(row, col), enemy))
+			return;
+	}
+
+	Move move;
+	move.pieceId = KING + color;
+	move.startRow = CASTLE;
+	move.startCol = CASTLE;
+	move.endRow = (rookCol == 7) ? KINGSIDE : QUEENSIDE;
+	move.endCol = move.endRow;
+
+	addMove(moves, move.pieceId, CASTLE, CASTLE, move.endRow, move.endCol, evaluateMove(pos, &move, evaluator));
+}
+
+/*
+ * Generate the legal moves of one color on a bitboard position.
+ */
+void generateLegalMoves(Position* pos, int color, int evaluator, MoveSet* moves)
+{
+	generateMoves(pos, color, evaluator, moves, FALSE);
+}
+
+/*
+ * Generate the legal captures and promotions of one color on a bitboard
+ * position, the moves searched by quiescence search.
+ */
+void generateCaptures(Position* pos, int color, int evaluator, MoveSet* moves)
+{
+	generateMoves(pos, color, evaluator, moves, TRUE);
+}
+
+/*
+ * Generate legal moves, or only captures and promotions.  Moves are
+ * generated pseudo-legally and filtered with masks computed once for
+ * the position: while in check only the checker and the squares between
+ * it and the king are allowed, and a pinned piece may only move along its
+ * pin.  King moves and en passant are tested explicitly.
+ */
+static void generateMoves(Position* pos, int color, int evaluator, MoveSet* moves, char capturesOnly)
+{
+	int us = COLOR_INDEX(color);
+	int enemy = (color == WHITE) ? BLACK : WHITE;
+	Bitboard* pieces = pos->pieces[us];
+	Bitboard* enemyPieces = pos->pieces[1 - us];
+	Bitboard enemies = pos->colors[1 - us];
+	Bitboard targets = capturesOnly ? enemies : ~pos->colors[us];
+	Bitboard empty = ~pos->occupied;
+	Bitboard evasion = ~0ULL;	//squares that resolve a check
+	Bitboard pinned = 0;
+	Bitboard pinRays[64];	//squares a pinned piece may move to, by square
+	Bitboard b, attacks;
+	int from, to;
+	int king = (pieces[KING] != 0) ? lowestSquare(pieces[KING]) : -1;
+
+	if (pieces[KING] != 0)
+	{
+		Bitboard checkers = attackersOf(pos, king, enemy, pos->occupied);
+		if (checkers != 0)
+		{
+			if (checkers & (checkers - 1))
+				evasion = 0;	//double check, only the king may move
+			else
+				evasion = checkers | betweenSquares[king][lowestSquare(checkers)];
+		}
+
+		//enemy sliders that would attack the king through exactly one of our pieces
+		Bitboard snipers = (rookAttacks(king, enemies) & (enemyPieces[ROOK] | enemyPieces[QUEEN])) |
+			(bishopAttacks(king, enemies) & (enemyPieces[BISHOP] | enemyPieces[QUEEN]));
+		while (snipers != 0)
+		{
+			int sniper = popSquare(&snipers);
+			Bitboard blockers = betweenSquares[king][sniper] & pos->occupied;
+			if (blockers != 0 && (blockers & (blockers - 1)) == 0 && (blockers & pos->colors[us]))
+			{
+				pinned |= blockers;
+				pinRays[lowestSquare(blockers)] = betweenSquares[king][sniper] | SQUARE_BIT(sniper);
+			}
+		}
+	}
+
+	//pawns
+	int forward = (color == WHITE) ? 8 : -8;
+	int startRow = (color == WHITE) ? 1 : 6;
+	int promoteRow = (color == WHITE) ? 6 : 1;	//row a pawn promotes from
+	int passant = pos->passantSquare;
+
+	for (b = pieces[PAWN]; b != 0; )
+	{
+		from = popSquare(&b);
+		Bitboard allowed = evasion;
+		if (pinned & SQUARE_BIT(from))
+			allowed &= pinRays[from];
+
+		to = from + forward;
+		if ((empty & SQUARE_BIT(to)) && (!capturesOnly || ROW_OF(from) == promoteRow))
+		{
+			if (allowed & SQUARE_BIT(to))
+				addLegal(pos, from, to, evaluator, moves);
+			if (ROW_OF(from) == startRow && (empty & allowed & SQUARE_BIT(to + forward)))
+				addLegal(pos, from, to + forward, evaluator, moves);
+		}
+
+		for (attacks = pawnAttacks[us][from] & enemies & allowed; attacks != 0; )
+			addLegal(pos, from, popSquare(&attacks), evaluator, moves);
+
+		if (passant >= 0 && ROW_OF(from) == ROW_OF(passant) &&
+			(COL_OF(from) == COL_OF(passant) - 1 || COL_OF(from) == COL_OF(passant) + 1))
+			addIfLegal(pos, color, from, passant + forward, evaluator, moves);
+	}
+
+	//knights (a pinned knight can never move)
+	for (b = pieces[KNIGHT] & ~pinned; b != 0; )
+	{
+		from = popSquare(&b);
+		for (attacks = knightAttacks[from] & targets & evasion; attacks != 0; )
+			addLegal(pos, from, popSquare(&attacks), evaluator, moves);
+	}
+
+	//bishops and queen diagonals
+	for (b = pieces[BISHOP] | pieces[QUEEN]; b != 0; )
+	{
+		from = popSquare(&b);
+		attacks = bishopAttacks(from, pos->occupied) & targets & evasion;
+		if (pinned & SQUARE_BIT(from))
+			attacks &= pinRays[from];
+		while (attacks != 0)
+			addLegal(pos, from, popSquare(&attacks), evaluator, moves);
+	}
+
+	//rooks and queen lines
+	for (b = pieces[ROOK] | pieces[QUEEN]; b != 0; )
+	{
+		from = popSquare(&b);
+		attacks = rookAttacks(from, pos->occupied) & targets & evasion;
+		if (pinned & SQUARE_BIT(from))
+			attacks &= pinRays[from];
+		while (attacks != 0)
+			addLegal(pos, from, popSquare(&attacks), evaluator, moves);
+	}
+
+	//king, tested against attacks that pass through its start square
+	if (pieces[KING] != 0)
+	{
+		Bitboard occupied = pos->occupied & ~pieces[KING];
+		for (attacks = kingAttacks[king] & targets; attacks != 0; )
+		{
+			to = popSquare(&attacks);
+			if (attackersOf(pos, to, enemy, occupied) == 0)
+				addLegal(pos, king, to, evaluator, moves);
+		}
+
+		if (capturesOnly)
+			return;
+		if (color == WHITE)
+		{
+			if (!(pos->castleFlags & WHITE_KCASTLE_INVALID))
+				addCastle(pos, color, 7, evaluator, moves);
+			if (!(pos->castleFlags & WHITE_QCASTLE_INVALID))
+				addCastle(pos, color, 0, evaluator, moves);
+		} else {
+			if (!(pos->castleFlags & BLACK_KCASTLE_INVALID))
+				addCastle(pos, color, 7, evaluator, moves);
+			if (!(pos->castleFlags & BLACK_QCASTLE_INVALID))
+				addCastle(pos, color, 0, evaluator, moves);
+		}
+	}
+}
+
 /*
  * Create a new MoveSet structure.
  */
@@ -2318,7 +2830,7 @@ MoveSet* newMoveSet()
 	MoveSet* set = (MoveSet*) malloc(sizeof(MoveSet));
 	set->cap = 100;
 	set->size = 0;
-	set->moves = (Move**) malloc(sizeof(Move*) * set->cap);
+	set->moves = (Move*) malloc(sizeof(Move) * set->cap);
 	return set;
 }
 
@@ -2331,23 +2843,17 @@ void addMove(MoveSet* set, char pieceId, int startRow, int startCol, int endRow,
 	if (set->size >= set->cap)
 	{
 		set->cap *= 2;
-		int i;
-		Move** oMoves = set->moves;
-		set->moves = (Move**) malloc(sizeof(Move*) * set->cap);
-		for (i = 0; i < set->size; i++)
-			set->moves[i] = oMoves[i];
-		free(oMoves);
+		set->moves = (Move*) realloc(set->moves, sizeof(Move) * set->cap);
 	}
 
 	//Add move
-	Move* move = (Move*) malloc(sizeof(Move));
+	Move* move = &set->moves[set->size++];
 	move->pieceId = pieceId;
 	move->startRow = (char) startRow;
 	move->startCol = (char) startCol;
 	move->endRow = (char) endRow;
 	move->endCol = (char) endCol;
 	move->boardScore = boardScore;
-	set->moves[set->size++] = move;
 }
 
 /*
@@ -2355,14 +2861,13 @@ void addMove(MoveSet* set, char pieceId, int startRow, int startCol, int endRow,
  */
 Move* getMove(MoveSet* set, int index)
 {
-	return set->moves[index];
+	return &set->moves[index];
 }
 
-/* Get board score.  Expressed as a difference between white and black.
- * Positive numbers show a better white score and negative numbers
- * indicate a better black score.
+/* Get board score by scanning the board square by square.  This is the
+ * original evaluation, kept as a reference for evaluatePosition().
  */
-int evaluateBoard(char* board, int functionId)
+int evaluateBoardScan(char* board, int functionId)
 {
 	int count;
 	char i, j;
@@ -2416,27 +2921,27 @@ int evaluateBoard(char* board, int functionId)
 						case PAWN:
 							count += pawnValue;
 							count += pawnAdvanceValue * i;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count += pawnValue / safetyRatio;
 							break;
 						case ROOK:
 							count += rookValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count += rookValue / safetyRatio;
 							break;
 						case KNIGHT:
 							count += knightValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count += knightValue / safetyRatio;
 							break;
 						case BISHOP:
 							count += bishopValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count += bishopValue / safetyRatio;
 							break;
 						case QUEEN:
 							count += queenValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count += queenValue / safetyRatio;
 							break;
 					}
@@ -2447,27 +2952,27 @@ int evaluateBoard(char* board, int functionId)
 						case BLACK + PAWN:
 							count -= pawnAdvanceValue * (7 - i);
 							count -= pawnValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count -= pawnValue / safetyRatio;
 							break;
 						case BLACK + ROOK:
 							count -= rookValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count -= rookValue / safetyRatio;
 							break;
 						case BLACK + KNIGHT:
 							count -= knightValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count -= knightValue / safetyRatio;
 							break;
 						case BLACK + BISHOP:
 							count -= bishopValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count -= bishopValue / safetyRatio;
 							break;
 						case BLACK + QUEEN:
 							count -= queenValue;
-							if (safetyRatio > 0 && pieceSafe(board, i, j))
+							if (safetyRatio > 0 && pieceSafeScan(board, i, j))
 								count -= queenValue / safetyRatio;
 							break;
 					}
@@ -2479,108 +2984,281 @@ int evaluateBoard(char* board, int functionId)
 	return count;
 }
 
+/* Get board score.  Expressed as a difference between white and black.
+ * Positive numbers show a better white score and negative numbers
+ * indicate a better black score.
+ */
+int evaluateBoard(char* board, int functionId)
+{
+	Position pos;
+	boardToPosition(board, &pos);
+	return evaluatePosition(&pos, functionId);
+}
+
+/*
+ * Get the score of a bitboard position.  Same scoring as evaluateBoard(),
+ * computed with popcounts over each piece type instead of a board scan.
+ */
+int evaluatePosition(Position* pos, int functionId)
+{
+	int count, type, row;
+	int values[7];
+	int pawnAdvanceValue, safetyRatio;
+	switch (functionId)
+	{
+		case ROB:			//Rob's values
+		default:			//also for an unknown evaluator
+			values[PAWN] = 100;
+			values[ROOK] = 500;
+			values[KNIGHT] = 300;
+			values[BISHOP] = 350;
+			values[QUEEN] = 900;
+			pawnAdvanceValue = 4;
+			safetyRatio = 30;
+			break;
+		case TURING:		//Turing's values
+			values[PAWN] = 100;
+			values[ROOK] = 500;
+			values[KNIGHT] = 300;
+			values[BISHOP] = 350;
+			values[QUEEN] = 1000;
+			pawnAdvanceValue = 0;
+			safetyRatio = 0;
+			break;
+		case BERLINER:
+			values[PAWN] = 100;
+			values[ROOK] = 510;
+			values[KNIGHT] = 320;
+			values[BISHOP] = 333;
+			values[QUEEN] = 880;
+			pawnAdvanceValue = 6;
+			safetyRatio = 0;
+			break;
+	}
+
+	Bitboard* white = pos->pieces[WHITE_INDEX];
+	Bitboard* black = pos->pieces[BLACK_INDEX];
+
+	//material
+	count = 0;
+	for (type = PAWN; type <= QUEEN; type++)
+		count += values[type] * (popCount(white[type]) - popCount(black[type]));
+
+	//pawn advancement, counted row by row
+	if (pawnAdvanceValue > 0)
+	{
+		for (row = 1; row < 7; row++)
+		{
+			count += pawnAdvanceValue * row * popCount(white[PAWN] & ROW_BITS(row));
+			count -= pawnAdvanceValue * (7 - row) * popCount(black[PAWN] & ROW_BITS(row));
+		}
+	}
+
+	//bonus for pieces not attacked by the other side
+	if (safetyRatio > 0)
+	{
+		Bitboard whiteSafe = ~attackedSquares(pos, BLACK);
+		Bitboard blackSafe = ~attackedSquares(pos, WHITE);
+		for (type = PAWN; type <= QUEEN; type++)
+		{
+			count += (values[type] / safetyRatio) * popCount(white[type] & whiteSafe);
+			count -= (values[type] / safetyRatio) * popCount(black[type] & blackSafe);
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Build the position for a char* board with the given color to move,
+ * taking the castling flags from the current game and the en passant pawn
+ * from the previous move.
+ */
+void loadPosition(char* board, int color, Move* prevMove, Position* pos)
+{
+	boardToPosition(board, pos);
+	pos->sideToMove = (char) color;
+	pos->castleFlags = getCastleFlags();
+	if (prevMove != NULL && prevMove->startRow >= 0 && prevMove->startCol == prevMove->endCol)
+	{
+		if ((prevMove->pieceId == PAWN && prevMove->startRow == 1 && prevMove->endRow == 3) ||
+			(prevMove->pieceId == PAWN + BLACK && prevMove->startRow == 6 && prevMove->endRow == 4))
+			pos->passantSquare = (char) SQUARE(prevMove->endRow, prevMove->endCol);
+	}
+	pos->key = computeKey(pos);
+}
+
 /*
  * Execute a move on the input board.
  */
 void executeMove(char* board, Move* move, Move* prevMove)
 {
-	char pieceId = getPieceAt(board, move->startRow, move->startCol);
-	if (move->startRow == CASTLE && move->endRow == KINGSIDE)
+	Position pos;
+	UndoRecord undo;
+	loadPosition(board, isBlack(move->pieceId) ? BLACK : WHITE, prevMove, &pos);
+	executeMove(&pos, move, &undo);
+	positionToBoard(&pos, board);
+	setCastleFlags(pos.castleFlags);
+}
+
+/*
+ * Pass the move to the other side and bring the Zobrist key up to date
+ * with the castling flags and en passant pawn left by a move.  The piece
+ * keys are kept up to date by addPiece() and removePiece().
+ */
+static void finishMove(Position* pos, UndoRecord* undo)
+{
+	pos->key ^= castleKeys[(int) undo->castleFlags] ^ castleKeys[(int) pos->castleFlags] ^ sideKey;
+	if (undo->passantSquare >= 0)
+		pos->key ^= passantKeys[COL_OF(undo->passantSquare)];
+	if (pos->passantSquare >= 0)
+		pos->key ^= passantKeys[COL_OF(pos->passantSquare)];
+	pos->sideToMove = (pos->sideToMove == WHITE) ? BLACK : WHITE;
+}
+
+/*
+ * Execute a move on a position, saving what undoMove() needs to take it
+ * back.
+ */
+void executeMove(Position* pos, Move* move, UndoRecord* undo)
+{
+	undo->key = pos->key;
+	undo->castleFlags = pos->castleFlags;
+	undo->passantSquare = pos->passantSquare;
+	undo->captured = EMPTY;
+	undo->captureSquare = -1;
+	pos->passantSquare = -1;
+
+	if (move->startRow == CASTLE)
 	{
-		//castle kingside
-		if (isBlack(move->pieceId) == TRUE)
+		int row = isBlack(move->pieceId) ? 7 : 0;
+		int color = isBlack(move->pieceId) ? BLACK : WHITE;
+		undo->moved = KING + color;
+		removePiece(pos, SQUARE(row, 4));
+		if (move->endRow == KINGSIDE)
 		{
-			//black
-			setPieceAt(board, 7, 4, EMPTY);
-			setPieceAt(board, 7, 7, EMPTY);
-			setPieceAt(board, 7, 6, BLACK + KING);
-			setPieceAt(board, 7, 5, BLACK + ROOK);
-			blackKCastleInvalid = TRUE;
-			blackQCastleInvalid = TRUE;
+			removePiece(pos, SQUARE(row, 7));
+			addPiece(pos, SQUARE(row, 6), KING + color);
+			addPiece(pos, SQUARE(row, 5), ROOK + color);
 		} else {
-			//white
-			setPieceAt(board, 0, 4, EMPTY);
-			setPieceAt(board, 0, 7, EMPTY);
-			setPieceAt(board, 0, 6, KING);
-			setPieceAt(board, 0, 5, ROOK);
-			whiteKCastleInvalid = TRUE;
-			whiteQCastleInvalid = TRUE;
+			removePiece(pos, SQUARE(row, 0));
+			addPiece(pos, SQUARE(row, 2), KING + color);
+			addPiece(pos, SQUARE(row, 3), ROOK + color);
 		}
-	} else if (move->startRow == CASTLE && move->endRow == QUEENSIDE) {
-		//castle queenside
-		if (isBlack(move->pieceId) == TRUE)
+		if (color == WHITE)
+			pos->castleFlags |= WHITE_KCASTLE_INVALID | WHITE_QCASTLE_INVALID;
+		else
+			pos->castleFlags |= BLACK_KCASTLE_INVALID | BLACK_QCASTLE_INVALID;
+		finishMove(pos, undo);
+		return;
+	}
+
+	int from = SQUARE(move->startRow, move->startCol);
+	int to = SQUARE(move->endRow, move->endCol);
+	char pieceId = pos->mailbox[from];
+	undo->moved = pieceId;
+
+	if (pieceId == KING)
+	{
+		pos->castleFlags |= WHITE_KCASTLE_INVALID | WHITE_QCASTLE_INVALID;
+	} else if (pieceId == BLACK + KING) {
+		pos->castleFlags |= BLACK_KCASTLE_INVALID | BLACK_QCASTLE_INVALID;
+	} else if (pieceId == ROOK) {
+		if (from == SQUARE(0, 0))
+			pos->castleFlags |= WHITE_QCASTLE_INVALID;
+		else if (from == SQUARE(0, 7))
+			pos->castleFlags |= WHITE_KCASTLE_INVALID;
+	} else if (pieceId == BLACK + ROOK) {
+		if (from == SQUARE(7, 0))
+			pos->castleFlags |= BLACK_QCASTLE_INVALID;
+		else if (from == SQUARE(7, 7))
+			pos->castleFlags |= BLACK_KCASTLE_INVALID;
+	}
+
+	if (pos->mailbox[to] != EMPTY)
+	{
+		undo->captured = pos->mailbox[to];
+		undo->captureSquare = (char) to;
+		removePiece(pos, to);
+	} else if (PIECE_TYPE(pieceId) == PAWN && move->startCol != move->endCol) {
+		//en passant, the captured pawn is beside the start square
+		int square = SQUARE(move->startRow, move->endCol);
+		undo->captured = pos->mailbox[square];
+		undo->captureSquare = (char) square;
+		removePiece(pos, square);
+	}
+
+	removePiece(pos, from);
+	if (pieceId == PAWN && move->endRow == 7)
+		addPiece(pos, to, QUEEN);
+	else if (pieceId == BLACK + PAWN && move->endRow == 0)
+		addPiece(pos, to, BLACK + QUEEN);
+	else
+		addPiece(pos, to, pieceId);
+
+	if (PIECE_TYPE(pieceId) == PAWN && (move->endRow - move->startRow == 2 || move->startRow - move->endRow == 2))
+		pos->passantSquare = (char) to;
+	finishMove(pos, undo);
+}
+
+/*
+ * Take back a move made by executeMove(Position*, ...).
+ */
+void undoMove(Position* pos, Move* move, UndoRecord* undo)
+{
+	pos->castleFlags = undo->castleFlags;
+	pos->passantSquare = undo->passantSquare;
+	pos->sideToMove = (pos->sideToMove == WHITE) ? BLACK : WHITE;
+
+	if (move->startRow == CASTLE)
+	{
+		int row = isBlack(move->pieceId) ? 7 : 0;
+		if (move->endRow == KINGSIDE)
 		{
-			//black
-			setPieceAt(board, 7, 0, EMPTY);
-			setPieceAt(board, 7, 4, EMPTY);
-			setPieceAt(board, 7, 2, BLACK + KING);
-			setPieceAt(board, 7, 3, BLACK + ROOK);
-			blackQCastleInvalid = TRUE;
-			blackKCastleInvalid = TRUE;
+			removePiece(pos, SQUARE(row, 6));
+			removePiece(pos, SQUARE(row, 5));
+			addPiece(pos, SQUARE(row, 7), undo->moved - KING + ROOK);
 		} else {
-			//white
-			setPieceAt(board, 0, 0, EMPTY);
-			setPieceAt(board, 0, 4, EMPTY);
-			setPieceAt(board, 0, 2, KING);
-			setPieceAt(board, 0, 3, ROOK);
-			whiteQCastleInvalid = TRUE;
-			whiteQCastleInvalid = TRUE;
-		}
-	} else {
-		if (pieceId == KING)
-		{
-			whiteKCastleInvalid = TRUE;
-			whiteQCastleInvalid = TRUE;
-		} else if (pieceId == BLACK + KING) {
-			blackKCastleInvalid = TRUE;
-			blackQCastleInvalid = TRUE;
-		} else if (pieceId == ROOK) {
-			if (move->startRow == 0 && move->startCol == 0)
-			{
-				whiteQCastleInvalid = TRUE;
-			} else if (move->startRow == 0 && move->startCol == 7) {
-				whiteKCastleInvalid = TRUE;
-			} else if (move->startRow == 7 && move->startCol == 0) {
-				blackQCastleInvalid = TRUE;
-			} else if (move->startRow == 7 && move->startCol == 7) {
-				blackKCastleInvalid = TRUE;
-			}
-		} else if (pieceId == PAWN) {
-			//check for white en passant case
-			if (move->startRow == 4 && move->endRow == 5 && move->startCol != move->endCol)
-			{
-				if (prevMove->pieceId == PAWN + BLACK && prevMove->startCol == prevMove->endCol &&
-					prevMove->endRow == 4 && (prevMove->endCol == move->startCol + 1 ||
-											  prevMove->endCol == move->startCol - 1))
-				{
-					//capture pawn
-					setPieceAt(board, 4, prevMove->endCol, EMPTY);
-				}
-			}
-		} else if (pieceId == PAWN + BLACK) {
-			//check for black en passant case
-			if (move->startRow == 3 && move->endRow == 2 && move->startCol != move->endCol)
-			{
-				if (prevMove->pieceId == PAWN && prevMove->startCol == prevMove->endCol &&
-					prevMove->endRow == 3 && (prevMove->endCol == move->startCol + 1 ||
-											  prevMove->endCol == move->startCol - 1))
-				{
-					//capture pawn
-					setPieceAt(board, 3, prevMove->endCol, EMPTY);
-				}
-			}
+			removePiece(pos, SQUARE(row, 2));
+			removePiece(pos, SQUARE(row, 3));
+			addPiece(pos, SQUARE(row, 0), undo->moved - KING + ROOK);
 		}
-		
-		setPieceAt(board, move->startRow, move->startCol, EMPTY);
-		setPieceAt(board, move->endRow, move->endCol, pieceId);
+		addPiece(pos, SQUARE(row, 4), undo->moved);
+		pos->key = undo->key;
+		return;
 	}
 
-	//convert pawn to queen if necessary
-	if (move->endRow == 7 && pieceId == PAWN)
-		setPieceAt(board, move->endRow, move->endCol, QUEEN);
+	removePiece(pos, SQUARE(move->endRow, move->endCol));
+	addPiece(pos, SQUARE(move->startRow, move->startCol), undo->moved);
+	if (undo->captured != EMPTY)
+		addPiece(pos, undo->captureSquare, undo->captured);
+	pos->key = undo->key;
+}
+
+/*
+ * Pass the turn on a position (a null move), for null-move pruning.  An en
+ * passant capture is no longer possible afterwards.
+ */
+void executeNullMove(Position* pos, UndoRecord* undo)
+{
+	undo->key = pos->key;
+	undo->castleFlags = pos->castleFlags;
+	undo->passantSquare = pos->passantSquare;
+	undo->moved = EMPTY;
+	undo->captured = EMPTY;
+	undo->captureSquare = -1;
+	pos->passantSquare = -1;
+	finishMove(pos, undo);
+}
 
-	if (move->endRow == 0 && pieceId == BLACK + PAWN)
-		setPieceAt(board, move->endRow, move->endCol, BLACK + QUEEN);
+/*
+ * Take back a null move.
+ */
+void undoNullMove(Position* pos, UndoRecord* undo)
+{
+	pos->passantSquare = undo->passantSquare;
+	pos->sideToMove = (pos->sideToMove == WHITE) ? BLACK : WHITE;
+	pos->key = undo->key;
 }
 
 /*
@@ -2653,7 +3331,7 @@ void printMoves(MoveSet* moveSet)
 	int i;
 	for (i = 0; i < moveSet->size; i++)
 	{
-		printMove(moveSet->moves[i]);
+		printMove(&moveSet->moves[i]);
 	}
 }
 
@@ -2662,259 +3340,2042 @@ void printMoves(MoveSet* moveSet)
  */
 void destroyMoveSet(MoveSet* set)
 {
-	int i;
-	for (i = 0; i < set->size; i++)
-		free(set->moves[i]);
 	free(set->moves);
 	free(set);
 }
 
 /*
- * Compute best move for a given board configuration and player. Depth specifies
- * "depth" of search.
+ * Narrow the window for searching a root move, given the best root move
+ * so far.  A move after the best one has to beat it, while a move before
+ * it only has to tie, so only moves that could change the result get an
+ * exact value.
  */
-Move* bestMove(char* board, int color, Move* prevMove, int depth, int evaluator)
+static void narrowRoot(int color, MoveDef* best, int index, RootWindow* window)
 {
-	MoveSet* legalMoves = getLegalMoves(board, color, prevMove, evaluator);
-	
-	if (legalMoves == NULL)
+	if (best->value == -INFINITY || best->value == INFINITY)
+		return;	//no root move searched yet
+
+	if (color == WHITE)
 	{
-		//No moves left
-		return NULL;
-	} else {
-		//Divide up problem space
-		int i, j;
-		int proc = COMM_WORLD.Get_rank();
-		int numProcs = COMM_WORLD.Get_size();
-		int segSize, procCap;
-		if (legalMoves->size >= numProcs - 1)
+		int alpha = (best->index < index) ? best->value : best->value - 1;
+		if (alpha > window->alpha)
 		{
-			//There were more moves than processors
-			segSize = legalMoves->size / (numProcs - 1);
-			procCap = numProcs;
-		} else {
-			//There are more processors than legal moves
-			segSize = 1;
-			procCap = legalMoves->size + 1;
-		}
-
-		//Distribute board and move data to slave nodes
-		MoveSet* sub;
-		for (i = 1, j = 0; i < procCap - 1; i++, j++)
-		{
-			sub = subMoveSet(legalMoves, j * segSize, segSize);
-			COMM_WORLD.Send(&color, 1, MPI_INT, i, 0);
-			COMM_WORLD.Send(&depth, 1, MPI_INT, i, 0);
-			COMM_WORLD.Send(&evaluator, 1, MPI_INT, i, 0);
-			COMM_WORLD.Send(board, 64, MPI_CHAR, i, 0);
-			sendMoveSet(i, sub);
-			sendMove(i, prevMove);
-			free(sub);
+			window->alpha = alpha;
+			window->changes++;
 		}
-
-		//Distribute last (potentially larger) segment
-		sub = subMoveSet(legalMoves, j * segSize, segSize + legalMoves->size % (procCap - 1));
-		COMM_WORLD.Send(&color, 1, MPI_INT, i, 0);
-		COMM_WORLD.Send(&depth, 1, MPI_INT, i, 0);
-		COMM_WORLD.Send(&evaluator, 1, MPI_INT, i, 0);
-		COMM_WORLD.Send(board, 64, MPI_CHAR, i, 0);
-		sendMoveSet(i, sub);
-		sendMove(i, prevMove);
-		free(sub);
-
-		//Initialize "best" variable
-		MoveDef* best = (MoveDef*) malloc(sizeof(MoveDef));
-		best->index = 0;
-		if (color == WHITE)
-			best->value = -INFINITY;
-		else
-			best->value = INFINITY;
-
-		//Retrieve other processed segments and determine best
-		MoveDef* tmp;
-		MoveDef* m;
-		for (i = 1; i < procCap; i++)
+	} else {
+		int beta = (best->index < index) ? best->value : best->value + 1;
+		if (beta < window->beta)
 		{
-			m = receiveMoveDef(i);
-			if (color == WHITE && m->value > best->value)
-			{
-				//New best found (white), update pointers
-				tmp = best;
-				best = m;
-				
-				//Make index relative to "legalMoves"
-				best->index = (i - 1) * segSize + best->index;
-			} else if (color == BLACK && m->value < best->value) {
-				//New best found (black), update pointers
-				tmp = best;
-				best = m;
-				
-				//Make index relative to "legalMoves"
-				best->index = (i - 1) * segSize + best->index;
-			} else {
-				tmp = m;
-			}
-			free(tmp);
+			window->beta = beta;
+			window->changes++;
 		}
-		
-		//Return move
-		Move* move = getMove(legalMoves, best->index);
-		return move;
 	}
 }
 
 /*
- * Recursive helper function for bestMove()
+ * Returns TRUE if searching a root move can no longer change the result:
+ * a mate has been found by a move earlier in the set, and the move could
+ * at best tie it.
  */
-MoveDef* bestMoveHelper(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator)
+static char rootMoveMoot(RootQueue* queue, int index)
+{
+	int mate = (queue->color == WHITE) ? CHECKMATE_VALUE : -CHECKMATE_VALUE;
+	return queue->best.value == mate && index > queue->best.index;
+}
+
+/*
+ * Returns TRUE if a unit can no longer change the result: its root move
+ * is moot, or the replies already searched hold the move to a value that
+ * cannot beat the best root move.
+ */
+static char unitMoot(RootQueue* queue, int unit)
+{
+	int index = queue->unitMove[unit];
+	int value = queue->moveValue[index];
+	MoveDef* best = &queue->best;
+	if (rootMoveMoot(queue, index))
+		return TRUE;
+	if (queue->color == WHITE)
+		return value < best->value || (value == best->value && index > best->index);
+	else
+		return value > best->value || (value == best->value && index > best->index);
+}
+
+/*
+ * Window for searching a unit: the root window, and for a reply the value
+ * the replies already searched hold its root move to, which the opponent
+ * only needs to improve on.
+ */
+static void unitWindow(RootQueue* queue, int unit, RootWindow* window)
+{
+	int index = queue->unitMove[unit];
+	window->alpha = -INFINITY;
+	window->beta = INFINITY;
+	if (queue->unitReply[unit] >= 0)
+	{
+		if (queue->color == WHITE)
+			window->beta = queue->moveValue[index];
+		else
+			window->alpha = queue->moveValue[index];
+	}
+	narrowRoot(queue->color, &queue->best, index, window);
+	window->changes = 0;
+}
+
+/*
+ * Send a job to a slave node: one unit to search, or a negative unit to
+ * end the search.
+ */
+static void sendJob(RootQueue* queue, int receiver, int unit)
+{
+	if (unit < 0)
+	{
+		int job[JOB_SIZE] = {unit};
+		COMM_WORLD.Send(job, JOB_SIZE, MPI_INT, receiver, 0);
+		return;
+	}
+	RootWindow window;
+	unitWindow(queue, unit, &window);
+	int job[JOB_SIZE] = {unit, queue->unitMove[unit], queue->unitReply[unit], window.alpha, window.beta};
+	COMM_WORLD.Send(job, JOB_SIZE, MPI_INT, receiver, 0);
+}
+
+/*
+ * Keep a root move's value if it is the best so far.  The lowest index
+ * wins a tie, as if the moves were searched in order.  Returns TRUE if
+ * the best move changed.
+ */
+static char recordResult(RootQueue* queue, int index, int value)
+{
+	MoveDef* best = &queue->best;
+	if ((queue->color == WHITE && (value > best->value || (value == best->value && index < best->index))) ||
+		(queue->color == BLACK && (value < best->value || (value == best->value && index < best->index))))
+	{
+		best->index = index;
+		best->value = value;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * Cancel the units being searched that can no longer change the result,
+ * on the slave nodes and on the head node.
+ */
+static void cancelMoot(RootQueue* queue)
+{
+	int i;
+	for (i = 1; i < COMM_WORLD.Get_size(); i++)
+	{
+		if (queue->requests[i] != REQUEST_NULL && !queue->cancelled[i] && queue->jobs[i] != STEALING &&
+			unitMoot(queue, queue->jobs[i]))
+		{
+			int cancel[JOB_SIZE] = {CANCEL_JOB, queue->jobs[i]};
+			COMM_WORLD.Send(cancel, JOB_SIZE, MPI_INT, i, 0);
+			queue->cancelled[i] = TRUE;
+		}
+	}
+	if (queue->headJob >= 0 && unitMoot(queue, queue->headJob))
+		queue->headStop = TRUE;
+}
+
+/*
+ * Tell the nodes still searching about a new best root move, so they can
+ * narrow their windows.  The units it makes moot are cancelled.
+ */
+static void shareBest(RootQueue* queue)
+{
+	int i;
+	cancelMoot(queue);
+	for (i = 1; i < COMM_WORLD.Get_size(); i++)
+	{
+		if (queue->requests[i] == REQUEST_NULL || queue->cancelled[i] || queue->jobs[i] == STEALING)
+			continue;	//idle, its result is ignored, or not searching a unit
+		int bound[JOB_SIZE] = {BOUND_JOB, queue->best.index, queue->best.value};
+		COMM_WORLD.Send(bound, JOB_SIZE, MPI_INT, i, 0);
+	}
+	if (queue->headJob >= 0)
+		narrowRoot(queue->color, &queue->best, queue->unitMove[queue->headJob], &queue->headWindow);
+}
+
+/*
+ * Account for a finished unit: fold its value into its root move's, or
+ * mark the move dropped if the unit was skipped or cancelled.  Once all
+ * units of a root move are in, the move's value is recorded.
+ */
+static void finishUnit(RootQueue* queue, int unit, int value, char searched)
+{
+	int index = queue->unitMove[unit];
+	if (!searched)
+	{
+		queue->moveDropped[index] = TRUE;
+	} else if (queue->color == WHITE) {
+		if (value < queue->moveValue[index])
+			queue->moveValue[index] = value;	//the opponent picks the reply
+	} else {
+		if (value > queue->moveValue[index])
+			queue->moveValue[index] = value;
+	}
+
+	if (--queue->movePending[index] == 0)
+	{
+		if (!queue->moveDropped[index] && recordResult(queue, index, queue->moveValue[index]))
+			shareBest(queue);
+	} else if (searched && queue->unitReply[unit] >= 0) {
+		cancelMoot(queue);	//the reply may refute the root move
+	}
+}
+
+/*
+ * Take the next unit worth searching from the queue, or return -1 if
+ * none are left or the budget has run out.  Units that can no longer
+ * change the result are skipped.
+ */
+static int nextUnit(RootQueue* queue)
+{
+	if (queue->budget != NULL && queue->budget->stop)
+		return -1;
+	while (queue->next < queue->units)
+	{
+		int unit = queue->next++;
+		if (!unitMoot(queue, unit))
+			return unit;
+		finishUnit(queue, unit, 0, FALSE);
+	}
+	return -1;
+}
+
+/*
+ * Pick a node for a thief to steal a split point's move from: the next
+ * one after the last picked that is searching a whole root move, the
+ * head node included.  Returns -1 if there is none, or if the threads
+ * do not split the tree.
+ */
+static int stealVictim(RootQueue* queue, int thief)
+{
+	int numProcs = COMM_WORLD.Get_size();
+	int i;
+	if (!splitSearch || queue->depth <= REMOTE_SPLIT_DEPTH)
+		return -1;	//no split point deep enough to hand out moves
+	for (i = 1; i <= numProcs; i++)
+	{
+		int node = (queue->victim + i) % numProcs;
+		if (node == thief)
+			continue;
+		if ((node == HEAD && queue->headJob >= 0 && !queue->headStop && queue->unitReply[queue->headJob] < 0) ||
+			(node != HEAD && queue->requests[node] != REQUEST_NULL && !queue->cancelled[node] &&
+			queue->jobs[node] != STEALING && queue->unitReply[queue->jobs[node]] < 0))
+		{
+			queue->victim = node;
+			return node;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Give a slave node the next unit.  With none left, the node is sent to
+ * steal a move from another node's split point, or waits for the end of
+ * the search.
+ */
+static void assignJob(RootQueue* queue, int node)
+{
+	int unit = nextUnit(queue);
+	if (unit >= 0)
+	{
+		sendJob(queue, node, unit);
+		queue->jobs[node] = unit;
+	} else {
+		int victim = stealVictim(queue, node);
+		if (victim < 0)
+			return;	//its search is ended with the others', see searchMoves()
+		int job[JOB_SIZE] = {STEAL_JOB, victim};
+		COMM_WORLD.Send(job, JOB_SIZE, MPI_INT, node, 0);
+		queue->jobs[node] = STEALING;
+	}
+	queue->cancelled[node] = FALSE;
+	queue->requests[node] = COMM_WORLD.Irecv(queue->results[node], RESULT_SIZE, MPI_INT, node, 0);
+	queue->sent[node] = Wtime();
+	queue->active++;
+}
+
+/*
+ * Handle the result of a slave node's job and give the node more work.
+ */
+static void handleResult(RootQueue* queue, int node)
+{
+	queue->busy[node] += Wtime() - queue->sent[node];
+	queue->active--;
+	if (queue->budget != NULL)
+		queue->budget->slaveNodes += queue->results[node][2];
+	if (queue->jobs[node] == STEALING)
+		queue->steals += queue->results[node][1];	//TRUE if there was a move to steal
+	else
+		finishUnit(queue, queue->jobs[node], queue->results[node][1], !queue->cancelled[node]);
+	assignJob(queue, node);
+}
+
+/*
+ * Wait for the next result from any slave node.
+ */
+static void collectResult(RootQueue* queue)
+{
+	int node = Request::Waitany(COMM_WORLD.Get_size(), queue->requests);
+	handleResult(queue, node);
+}
+
+/*
+ * Fill the work queue.  Each root move is a unit, unless the root has
+ * fewer moves than there are nodes: then each reply to each root move is
+ * a unit, and a root move's value is put together from its replies'.
+ * Root moves with no reply are scored here.  The units of root move
+ * first are handed out first.  Returns TRUE if split.
+ */
+static char fillQueue(RootQueue* queue, char* board, int color, Move* prevMove, int depth, int numProcs, int first)
+{
+	MoveSet* legalMoves = queue->legalMoves;
+	int size = legalMoves->size;
+	int i, j, k;
+	char split = (depth >= 2 && size < numProcs);
+	queue->movePending = (int*) malloc(sizeof(int) * size);
+	queue->moveValue = (int*) malloc(sizeof(int) * size);
+	queue->moveDropped = (char*) malloc(size);
+	queue->units = 0;
+
+	MoveSet* replies = newMoveSet();
+	Position pos;
+	loadPosition(board, color, prevMove, &pos);
+	int nextColor = (color == WHITE) ? BLACK : WHITE;
+	for (i = 0; i < size; i++)
+	{
+		queue->moveValue[i] = (color == WHITE) ? INFINITY : -INFINITY;
+		queue->moveDropped[i] = FALSE;
+		queue->movePending[i] = 1;
+		if (split)
+		{
+			UndoRecord undo;
+			Move* move = getMove(legalMoves, i);
+			executeMove(&pos, move, &undo);
+			replies->size = 0;
+			generateLegalMoves(&pos, nextColor, UNSCORED, replies);
+			if (replies->size == 0)
+			{
+				//checkmate or stalemate, nothing to search
+				if (!positionInCheck(&pos, nextColor))
+					queue->moveValue[i] = 0;
+				else
+					queue->moveValue[i] = (color == WHITE) ? CHECKMATE_VALUE : -CHECKMATE_VALUE;
+				queue->movePending[i] = 0;
+				recordResult(queue, i, queue->moveValue[i]);
+			} else {
+				queue->movePending[i] = replies->size;
+			}
+			undoMove(&pos, move, &undo);
+		}
+		queue->units += queue->movePending[i];
+	}
+	destroyMoveSet(replies);
+
+	queue->unitMove = (int*) malloc(sizeof(int) * queue->units);
+	queue->unitReply = (int*) malloc(sizeof(int) * queue->units);
+	int unit = 0;
+	for (k = 0; k < size; k++)
+	{
+		//the first move's units go out first, the rest in order
+		i = (k == 0) ? first : ((k <= first) ? k - 1 : k);
+		for (j = 0; j < queue->movePending[i]; j++, unit++)
+		{
+			queue->unitMove[unit] = i;
+			queue->unitReply[unit] = split ? j : -1;
+		}
+	}
+	return split;
+}
+
+/*
+ * Stop the search once its budget has run out: cancel every unit still
+ * being searched, on the slave nodes and on the head node, which stops
+ * the moves stolen from them too.  No more units are handed out, see
+ * nextUnit().
+ */
+static void checkBudget(RootQueue* queue)
+{
+	int i;
+	if (queue->budget == NULL || queue->budget->stop)
+		return;
+	pollBudget(queue->budget);
+	if (!queue->budget->stop)
+		return;
+	for (i = 1; i < COMM_WORLD.Get_size(); i++)
+	{
+		if (queue->requests[i] != REQUEST_NULL && !queue->cancelled[i] && queue->jobs[i] != STEALING)
+		{
+			int cancel[JOB_SIZE] = {CANCEL_JOB, queue->jobs[i]};
+			COMM_WORLD.Send(cancel, JOB_SIZE, MPI_INT, i, 0);
+			queue->cancelled[i] = TRUE;
+		}
+	}
+	if (queue->headJob >= 0)
+		queue->headStop = TRUE;
+}
+
+/*
+ * Search poll hook for the head node: handle any results that have
+ * arrived, so slave nodes get new work while the head is searching, serve
+ * the nodes stealing from it, and stop the search if its budget has run
+ * out.
+ */
+static void pollResults(void* data)
+{
+	RootQueue* queue = (RootQueue*) data;
+	int node;
+	if (splitSearch)
+		serveSteals();
+	while (queue->active > 0 && Request::Testany(COMM_WORLD.Get_size(), queue->requests, node))
+		handleResult(queue, node);
+	checkBudget(queue);
+}
+
+/*
+ * Search poll hook for a slave node: narrow the job's window when the
+ * head node shares a better root move, and stop if it cancels the job.
+ * While a job is searched the head sends nothing else.  Nodes stealing
+ * from this one are served too.
+ */
+static void pollHead(void* data)
+{
+	SlaveJob* job = (SlaveJob*) data;
+	if (splitSearch)
+		serveSteals();
+	while (COMM_WORLD.Iprobe(HEAD, 0))
+	{
+		int message[JOB_SIZE];
+		COMM_WORLD.Recv(message, JOB_SIZE, MPI_INT, HEAD, 0);
+		if (message[0] == CANCEL_JOB && message[1] == job->unit)
+		{
+			job->stop = TRUE;
+		} else if (message[0] == BOUND_JOB) {
+			MoveDef best = {message[1], message[2]};
+			narrowRoot(job->color, &best, job->index, &job->window);
+		}
+	}
+}
+
+/*
+ * Compute best move for a given board configuration and player. Depth specifies
+ * "depth" of search.
+ */
+Move* bestMove(char* board, int color, Move* prevMove, int depth, int evaluator)
+{
+	MoveSet* legalMoves = getLegalMoves(board, color, prevMove, evaluator);
+	
+	if (legalMoves == NULL)
+	{
+		//No moves left
+		return NULL;
+	}
+	MoveDef* best = searchMoves(board, color, prevMove, depth, legalMoves, evaluator, 0, NULL);
+	Move* move = getMove(legalMoves, best->index);
+	free(best);
+	return move;
+}
+
+/*
+ * Search the root moves depth plies deep, trying root move first before
+ * the others, on this node or spread over the nodes.  Returns the best
+ * move's index in legalMoves and its value.  A search spread over the
+ * nodes stops once budget (if not NULL) runs out; on a single node the
+ * caller polls the budget itself.
+ */
+static MoveDef* searchMoves(char* board, int color, Move* prevMove, int depth, MoveSet* legalMoves, int evaluator, int first, SearchBudget* budget)
+{
+	if (COMM_WORLD.Get_size() == 1 || depth == 0)
+	{
+		//Single node (or nothing to search below the root), search in this process
+		//on a copy of the root moves with the first one moved to the front
+		int i;
+		MoveSet* ordered = newMoveSet();
+		for (i = 0; i < legalMoves->size; i++)
+		{
+			Move* move = getMove(legalMoves, (i == 0) ? first : ((i <= first) ? i - 1 : i));
+			addMove(ordered, move->pieceId, move->startRow, move->startCol, move->endRow, move->endCol, move->boardScore);
+		}
+		MoveDef* best = bestMoveThreaded(board, color, depth, ordered, prevMove, evaluator, -INFINITY, INFINITY, searchThreads);
+		best->index = (best->index == 0) ? first : ((best->index <= first) ? best->index - 1 : best->index);
+		destroyMoveSet(ordered);
+		return best;
+	} else {
+		//Work queue: units are handed out one at a time, and a node gets
+		//the next one as soon as it finishes one.  The head node takes
+		//units from the queue too, collecting results while it searches.
+		int i;
+		int numProcs = COMM_WORLD.Get_size();
+		RootQueue queue;
+		queue.legalMoves = legalMoves;
+		queue.color = color;
+		queue.depth = depth;
+		queue.next = 0;
+		queue.active = 0;
+		queue.jobs = (int*) malloc(sizeof(int) * numProcs);
+		queue.cancelled = (char*) malloc(numProcs);
+		queue.requests = new Request[numProcs];
+		queue.results = (int (*)[RESULT_SIZE]) malloc(sizeof(int) * RESULT_SIZE * numProcs);
+		queue.sent = (double*) malloc(sizeof(double) * numProcs);
+		queue.busy = (double*) malloc(sizeof(double) * numProcs);
+		queue.best.index = 0;
+		queue.best.value = (color == WHITE) ? -INFINITY : INFINITY;
+		queue.headJob = -1;
+		queue.budget = budget;
+		queue.victim = HEAD;
+		queue.steals = 0;
+		for (i = 0; i < numProcs; i++)
+		{
+			queue.busy[i] = 0;
+			queue.requests[i] = REQUEST_NULL;
+		}
+		double start = Wtime();
+		char split = fillQueue(&queue, board, color, prevMove, depth, numProcs, first);
+
+		//the slave nodes generate the same legal moves from their copies of the game
+		Position pos;
+		loadPosition(board, color, prevMove, &pos);
+		int command[COMMAND_SIZE] = {SEARCH_COMMAND, color, depth, evaluator,
+			(int) (pos.key & 0xFFFFFFFF), (int) (pos.key >> 32)};
+		broadcastCommand(command);
+
+		for (i = 1; i < numProcs; i++)
+			assignJob(&queue, i);
+
+		//Search units on the head node until the queue is empty
+		int unit;
+		while ((unit = nextUnit(&queue)) >= 0)
+		{
+			int index = queue.unitMove[unit];
+			double searchStart = Wtime();
+			queue.headJob = unit;
+			queue.headStop = FALSE;
+			unitWindow(&queue, unit, &queue.headWindow);
+			mainContext.poll = pollResults;
+			mainContext.pollData = &queue;
+			mainContext.stop = &queue.headStop;
+			mainContext.window = &queue.headWindow;
+			int value;
+			if (queue.unitReply[unit] < 0)
+			{
+				MoveSet* sub = subMoveSet(legalMoves, index, 1);
+				MoveDef* m = bestMoveThreaded(board, color, depth, sub, prevMove, evaluator,
+					queue.headWindow.alpha, queue.headWindow.beta, nodeThreads);
+				value = m->value;
+				free(m);
+				free(sub);
+			} else {
+				value = searchReply(board, color, prevMove, depth, legalMoves, index, queue.unitReply[unit], evaluator,
+					queue.headWindow.alpha, queue.headWindow.beta);
+			}
+			mainContext.poll = NULL;
+			mainContext.stop = NULL;
+			mainContext.window = NULL;
+			queue.headJob = -1;
+			queue.busy[HEAD] += Wtime() - searchStart;
+			finishUnit(&queue, unit, value, !queue.headStop);
+			pollResults(&queue);
+		}
+
+		//Wait for the slave nodes still searching, stopping them if the
+		//budget runs out meanwhile, then end their searches
+		while (queue.active > 0)
+		{
+			if (budget == NULL && !splitSearch)
+			{
+				collectResult(&queue);
+			} else {
+				pollResults(&queue);
+				sched_yield();
+			}
+		}
+		for (i = 1; i < numProcs; i++)
+			sendJob(&queue, i, -1);
+
+		//Add up how long each node waited for work, reported once per
+		//move by bestMoveIterative() or here for a single search
+		if (idleReport.busy == NULL)
+			idleReport.busy = (double*) calloc(numProcs, sizeof(double));
+		idleReport.elapsed += Wtime() - start;
+		for (i = 0; i < numProcs; i++)
+			idleReport.busy[i] += queue.busy[i];
+		idleReport.searches++;
+		idleReport.splits += split;
+		idleReport.steals += queue.steals;
+		if (budget == NULL)
+			printIdleReport();
+
+		free(queue.jobs);
+		free(queue.cancelled);
+		delete[] queue.requests;
+		free(queue.results);
+		free(queue.sent);
+		free(queue.busy);
+		free(queue.unitMove);
+		free(queue.unitReply);
+		free(queue.movePending);
+		free(queue.moveValue);
+		free(queue.moveDropped);
+
+		//Return move
+		MoveDef* best = (MoveDef*) malloc(sizeof(MoveDef));
+		*best = queue.best;
+		return best;
+	}
+}
+
+/*
+ * Search poll hook for bestMoveIterative(): stop the search once its time
+ * or node budget has run out, unless it is the first one.
+ */
+static void pollBudget(void* data)
+{
+	SearchBudget* budget = (SearchBudget*) data;
+	if (!budget->armed)
+		return;
+	if (budget->deadline > 0 && Wtime() >= budget->deadline)
+		budget->stop = TRUE;
+	if (budget->nodeLimit > 0 && searchNodes + mainContext.nodes + budget->slaveNodes >= budget->nodeLimit)
+		budget->stop = TRUE;
+}
+
+/*
+ * Iterative deepening driver around bestMove(): search the position 1, 2,
+ * 3... plies deep until maxDepth, or until the time (in seconds) or node
+ * budget runs out, and return the best move of the deepest search that
+ * finished.  A budget of 0 is no limit.  Each search tries the previous
+ * one's best move first, and finds the previous ones' results in the
+ * transposition table to order the moves below the root.  A search
+ * still running when the budget runs out is abandoned, except the first,
+ * so there is always a searched move to return; no search is started
+ * once half the budget is gone.  Nodes are counted over all the nodes.
+ */
+Move* bestMoveIterative(char* board, int color, Move* prevMove, int maxDepth, double timeLimit, long nodeLimit, int evaluator)
+{
+	MoveSet* legalMoves = getLegalMoves(board, color, prevMove, evaluator);
+	if (legalMoves == NULL)
+		return NULL;	//No moves left
+
+	double start = Wtime();
+	long startNodes = searchNodes;
+	long startCutoffs = searchCutoffs;
+	long startFirst = firstCutoffs;
+	char local = (COMM_WORLD.Get_size() == 1);
+	SearchBudget budget;
+	budget.deadline = (timeLimit > 0) ? start + timeLimit : 0;
+	budget.nodeLimit = (nodeLimit > 0) ? startNodes + nodeLimit : 0;
+	budget.slaveNodes = 0;
+	budget.armed = FALSE;
+	budget.stop = FALSE;
+	if (local)
+	{
+		//a search spread over the nodes polls the budget in pollResults()
+		mainContext.poll = pollBudget;
+		mainContext.pollData = &budget;
+		mainContext.stop = &budget.stop;
+	}
+
+	int depth, completed = 0;
+	MoveDef best;
+	best.index = 0;
+	best.value = 0;
+	for (depth = 1; depth <= maxDepth && depth < MAX_PLY - 2; depth++)
+	{
+		if (legalMoves->size == 1)
+			break;	//nothing to choose between
+		if (depth > 1 && timeLimit > 0 && Wtime() - start >= timeLimit / 2)
+			break;	//the next search would most likely not finish
+		if (depth > 1 && nodeLimit > 0 && searchNodes - startNodes + budget.slaveNodes >= nodeLimit / 2)
+			break;
+
+		budget.armed = (depth > 1);
+		MoveDef* result = searchMoves(board, color, prevMove, depth, legalMoves, evaluator, best.index, &budget);
+		if (budget.stop)
+		{
+			free(result);
+			break;	//abandoned, keep the last finished search's move
+		}
+		best = *result;
+		completed = depth;
+		free(result);
+		if (best.value >= CHECKMATE_VALUE || best.value <= -CHECKMATE_VALUE)
+			break;	//a forced mate, deeper searches find the same
+	}
+
+	if (local)
+	{
+		mainContext.poll = NULL;
+		mainContext.stop = NULL;
+	} else {
+		printIdleReport();
+	}
+	long cutoffs = searchCutoffs - startCutoffs;
+	printf("SEARCHED %d PLIES IN %.3fs, %ld NODES, %.1f%% OF CUTOFFS ON THE FIRST MOVE\n", completed, Wtime() - start,
+		searchNodes - startNodes + budget.slaveNodes, (cutoffs > 0) ? 100.0 * (firstCutoffs - startFirst) / cutoffs : 0.0);
+	fflush(stdout);
+	return getMove(legalMoves, best.index);
+}
+
+/*
+ * Print how long each node sat idle over the searches spread over the
+ * nodes since the last report, how many were split at ply 2 and how many
+ * moves were stolen, and start a new report.
+ */
+static void printIdleReport()
+{
+	int i;
+	int numProcs = COMM_WORLD.Get_size();
+	double totalBusy = 0;
+	if (idleReport.searches == 0)
+		return;
+	printf("SEARCH %.3fs, IDLE:", idleReport.elapsed);
+	for (i = 0; i < numProcs; i++)
+	{
+		printf(" %d:%.3fs", i, idleReport.elapsed - idleReport.busy[i]);
+		totalBusy += idleReport.busy[i];
+		idleReport.busy[i] = 0;
+	}
+	printf(", IDEAL %.3fs", totalBusy / numProcs);
+	if (idleReport.splits > 0)
+		printf(", %d OF %d SEARCHES SPLIT AT PLY 2", idleReport.splits, idleReport.searches);
+	if (idleReport.steals > 0)
+		printf(", %d MOVES STOLEN", idleReport.steals);
+	printf("\n");
+	fflush(stdout);
+	idleReport.elapsed = 0;
+	idleReport.searches = 0;
+	idleReport.splits = 0;
+	idleReport.steals = 0;
+}
+
+/*
+ * Recursive helper function for bestMove().  Performs a fail-soft alpha-beta
+ * search: white maximizes and black minimizes, and a node stops expanding
+ * children once its value falls outside the (alpha, beta) window.  With
+ * pruning disabled (see setSearchPruning()) this is a plain minimax search.
+ */
+MoveDef* bestMoveHelper(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta)
+{
+	MoveDef* best = searchRoot(&mainContext, board, color, depth, legalMoves, prevMove, evaluator, alpha, beta);
+	collectCounts(&mainContext);
+	return best;
+}
+
+/*
+ * Search from the root for one thread's context.
+ */
+static MoveDef* searchRoot(SearchContext* ctx, char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta)
 {
-	//Save state of castle variables
-	char tmpWKC = whiteKCastleInvalid;
-	char tmpWQC = whiteQCastleInvalid;
-	char tmpBKC = blackKCastleInvalid;
-	char tmpBQC = blackQCastleInvalid;
-	
 	if (depth == 0)
 	{
 		//we have reached the end of the search (base case)
 		//determine best greedy legal move
 		int i, best;
+		int bestIndex = 0;
 		if (color == WHITE)
 			best = -INFINITY;
 		else
-			best = INFINITY;
-		for (i = 0; i < legalMoves->size; i++)
+			best = INFINITY;
+		for (i = 0; i < legalMoves->size; i++)
+		{
+			Move* move = getMove(legalMoves, i);
+			ctx->nodes++;
+			if (color == WHITE)
+			{
+				//white
+				if (move->boardScore > best)
+				{
+					best = move->boardScore;	//update best move
+					bestIndex = i;
+				}
+				if (pruningEnabled && best >= beta)
+					break;	//cutoff, black will avoid this line
+			} else {
+				//black
+				if (move->boardScore < best)
+				{
+					best = move->boardScore;	//update best move
+					bestIndex = i;
+				}
+				if (pruningEnabled && best <= alpha)
+					break;	//cutoff, white will avoid this line
+			}
+		}
+		
+		//choose random best move if multiple close to best
+		int icount = 0;
+		int* indices = (int*) malloc(sizeof(int) * legalMoves->size);
+		for (i = 0; i < legalMoves->size; i++)
+		{
+			Move* move = getMove(legalMoves, i);
+			if (abs(best - move->boardScore) <= RAND_RANGE)
+				indices[icount++] = i;
+		}
+		
+		MoveDef* m = (MoveDef*) malloc(sizeof(MoveDef));
+		if (ctx->seed == 0)
+			ctx->seed = (unsigned int) rand() | 1;	//seeded from the game's srand()
+		if (icount == 0)
+			m->index = bestIndex;	//no moves to choose between
+		else
+			m->index = indices[(int) rand_r(&ctx->seed) % icount];
+		m->value = best;
+		free(indices);
+		
+		return m;
+	} else {
+		//recursive case, searched on one position with make/unmake
+		Position pos;
+		loadPosition(board, color, prevMove, &pos);
+
+		useEvaluator(evaluator);
+
+		MoveDef* best = (MoveDef*) malloc(sizeof(MoveDef));
+		best->value = searchPosition(ctx, &pos, color, depth, legalMoves, evaluator, alpha, beta, 0, &best->index);
+		return best;
+	}
+}
+
+/*
+ * Search one reply to a root move, a work unit when bestMove() splits
+ * the root at ply 2: make the root move and the reply, then search the
+ * position that follows depth - 2 plies deep.  Uses the calling thread's
+ * context.
+ */
+static int searchReply(char* board, int color, Move* prevMove, int depth, MoveSet* legalMoves, int index, int reply, int evaluator, int alpha, int beta)
+{
+	SearchContext* ctx = &mainContext;
+	Position pos;
+	UndoRecord rootUndo, replyUndo;
+	int nextColor = (color == WHITE) ? BLACK : WHITE;
+	int value, bestIndex, i;
+	loadPosition(board, color, prevMove, &pos);
+	useEvaluator(evaluator);
+	for (i = 0; i < 2; i++)
+		if (ctx->plyMoves[i] == NULL)
+			ctx->plyMoves[i] = newMoveSet();
+
+	//replies are generated in the same order as by fillQueue()
+	Move* move = getMove(legalMoves, index);
+	executeMove(&pos, move, &rootUndo);
+	MoveSet* replies = ctx->plyMoves[0];
+	replies->size = 0;
+	generateLegalMoves(&pos, nextColor, UNSCORED, replies);
+	Move* replyMove = getMove(replies, reply);
+	executeMove(&pos, replyMove, &replyUndo);
+	MoveSet* nextLegal = ctx->plyMoves[1];
+	nextLegal->size = 0;
+	generateLegalMoves(&pos, color, UNSCORED, nextLegal);
+	ctx->nodes += 2;
+
+	if (nextLegal->size == 0)
+	{
+		//no legal moves available, either a checkmate or stalemate
+		if (!positionInCheck(&pos, color))
+			value = 0;	//stalemate
+		else if (color == WHITE)
+			value = -CHECKMATE_VALUE;	//white's king in checkmate
+		else
+			value = CHECKMATE_VALUE;	//black's king in checkmate
+	} else {
+		value = searchPosition(ctx, &pos, color, depth - 2, nextLegal, evaluator, alpha, beta, 2, &bestIndex);
+	}
+	undoMove(&pos, replyMove, &replyUndo);
+	undoMove(&pos, move, &rootUndo);
+
+	collectCounts(ctx);
+	return value;
+}
+
+/*
+ * Add a context's counts to the search statistics and zero them.
+ */
+static void collectCounts(SearchContext* ctx)
+{
+	searchNodes += ctx->nodes;
+	searchCutoffs += ctx->cutoffs;
+	firstCutoffs += ctx->firstCutoffs;
+	ctx->nodes = 0;
+	ctx->cutoffs = 0;
+	ctx->firstCutoffs = 0;
+}
+
+/*
+ * Value rank of the piece a move captures, plus a queen's for a
+ * promotion, or 0 for a quiet move.
+ */
+static int captureRank(Position* pos, Move* move)
+{
+	if (move->startRow == CASTLE)
+		return 0;
+	int rank = orderRanks[PIECE_TYPE(pos->mailbox[SQUARE(move->endRow, move->endCol)])];
+	if (PIECE_TYPE(move->pieceId) == PAWN)
+	{
+		if (move->startCol != move->endCol && rank == 0)
+			rank = orderRanks[PAWN];	//en passant
+		if (move->endRow == 0 || move->endRow == 7)
+			rank += orderRanks[QUEEN];
+	}
+	return rank;
+}
+
+/*
+ * Order a node's moves for the search: the transposition table's move
+ * first, then captures and promotions by most valuable victim and least
+ * valuable attacker (MVV-LVA), then the ply's two killer moves, then the
+ * other quiet moves by their history score.
+ */
+static void orderMoves(SearchContext* ctx, Position* pos, int color, MoveSet* legalMoves, int hashMove, int ply)
+{
+	int scores[MAX_MOVES];
+	int i, j;
+	int* history = &ctx->history[COLOR_INDEX(color)][0][0];
+	for (i = 0; i < legalMoves->size; i++)
+	{
+		Move* move = getMove(legalMoves, i);
+		int packed = packMove(move);
+		int rank = captureRank(pos, move);
+		if (packed == hashMove)
+			scores[i] = HASH_ORDER;
+		else if (rank > 0)
+			scores[i] = CAPTURE_ORDER + rank * 8 - orderRanks[PIECE_TYPE(move->pieceId)];
+		else if (packed == ctx->killers[ply][0])
+			scores[i] = KILLER_ORDER + 1;
+		else if (packed == ctx->killers[ply][1])
+			scores[i] = KILLER_ORDER;
+		else if (move->startRow == CASTLE)
+			scores[i] = 0;
+		else
+			scores[i] = history[SQUARE(move->startRow, move->startCol) * 64 + SQUARE(move->endRow, move->endCol)];
+	}
+
+	//insertion sort, highest score first and ties in generated order
+	for (i = 1; i < legalMoves->size; i++)
+	{
+		int score = scores[i];
+		Move move = legalMoves->moves[i];
+		for (j = i; j > 0 && scores[j - 1] < score; j--)
+		{
+			scores[j] = scores[j - 1];
+			legalMoves->moves[j] = legalMoves->moves[j - 1];
+		}
+		scores[j] = score;
+		legalMoves->moves[j] = move;
+	}
+}
+
+/*
+ * Count a node cut off by a move that failed high, and remember the move,
+ * if quiet, as a killer at its ply and in the history table.
+ */
+static void recordCutoff(SearchContext* ctx, Position* pos, int color, Move* move, int index, int depth, int ply)
+{
+	ctx->cutoffs++;
+	if (index == 0)
+		ctx->firstCutoffs++;
+	if (captureRank(pos, move) > 0)
+		return;
+
+	int packed = packMove(move);
+	if (ctx->killers[ply][0] != packed)
+	{
+		ctx->killers[ply][1] = ctx->killers[ply][0];
+		ctx->killers[ply][0] = packed;
+	}
+	if (move->startRow == CASTLE)
+		return;
+
+	int (*history)[64] = ctx->history[COLOR_INDEX(color)];
+	int* score = &history[SQUARE(move->startRow, move->startCol)][SQUARE(move->endRow, move->endCol)];
+	*score += depth * depth + 1;	//cutoffs at depth 0, the most frequent, count too
+	if (*score >= HISTORY_MAX)
+	{
+		int from, to;
+		for (from = 0; from < 64; from++)
+			for (to = 0; to < 64; to++)
+				history[from][to] /= 2;
+	}
+}
+
+/*
+ * Table scores depend on the evaluator, so keys are salted by the one the
+ * search uses (see tableKey()) instead of clearing a table other
+ * processes on the host may be using.
+ */
+static void useEvaluator(int evaluator)
+{
+	tableEvaluator = evaluator;
+}
+
+/*
+ * Narrow a node's window to the context's root window, if it has one.
+ */
+static void narrowWindow(SearchContext* ctx, int* alpha, int* beta)
+{
+	if (ctx->window == NULL)
+		return;
+	if (*alpha < ctx->window->alpha)
+		*alpha = ctx->window->alpha;
+	if (*beta > ctx->window->beta)
+		*beta = ctx->window->beta;
+}
+
+/*
+ * Store a node's result in the transposition table, with the bound type
+ * given by where it fell relative to the node's starting window.  changes
+ * is the root window's change count when the node was started.
+ */
+static void storeResult(SearchContext* ctx, Position* pos, int depth, MoveSet* legalMoves, int alpha, int beta, int ply, int value, int bestIndex, int changes)
+{
+	if (!pruningEnabled || ply == 0 || (ctx->stop != NULL && *ctx->stop) || splitCut(ctx->split))
+		return;	//nothing to share, or the value is from an abandoned search
+	if (ctx->window != NULL && ctx->window->changes != changes)
+		return;	//the window moved under the node, so the value may not be a bound
+
+	int bound;
+	if (value <= alpha)
+		bound = UPPER_BOUND;
+	else if (value >= beta)
+		bound = LOWER_BOUND;
+	else
+		bound = EXACT_BOUND;
+	int move = packMove(getMove(legalMoves, bestIndex));
+	if (ctx == &mainContext)
+		storeCluster(tableKey(pos->key, tableEvaluator), depth, bound, value, move);	//only the calling thread makes MPI calls
+	else
+		storeTable(tableKey(pos->key, tableEvaluator), depth, bound, value, move);
+}
+
+/*
+ * Returns TRUE if a node may try a null move: the side to move is not in
+ * check, has a piece besides its king and pawns (with only pawns, passing
+ * could be better than any move, so a null move would prove nothing), and
+ * the bound it has to beat is not a mate score.
+ */
+static char nullMoveSafe(Position* pos, int color, int alpha, int beta)
+{
+	Bitboard* pieces = pos->pieces[COLOR_INDEX(color)];
+	int bound = (color == WHITE) ? beta : alpha;
+	if (bound >= MATE_BOUND || bound <= -MATE_BOUND)
+		return FALSE;
+	if ((pieces[ROOK] | pieces[KNIGHT] | pieces[BISHOP] | pieces[QUEEN]) == 0)
+		return FALSE;
+	return !positionInCheck(pos, color);
+}
+
+/*
+ * Principal variation search of a move after a node's first: show the
+ * move is no better than the best so far with a zero window, late quiet
+ * moves also a few plies shallower, and search it again if it is better.
+ * pos is the position after the move, made by color at the node's depth
+ * and ply, with the reply set generated; quiet and inCheck tell whether
+ * the move captures nothing and whether color was in check before it.
+ */
+static int searchLaterMove(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* nextLegal, int evaluator, int alpha, int beta, int ply, Move* move, int index, char quiet, char inCheck)
+{
+	int nextColor = (color == WHITE) ? BLACK : WHITE;
+	int reduction = 0;
+	int bestIndex;
+	if (reductionsEnabled && depth >= LMR_MIN_DEPTH && index >= LMR_MIN_MOVES && !inCheck &&
+		quiet && packMove(move) != ctx->killers[ply][0] &&
+		packMove(move) != ctx->killers[ply][1] && !positionInCheck(pos, nextColor))
+		reduction = reductions[depth][index];
+	int value = zeroWindow(ctx, pos, nextColor, depth - 1 - reduction, nextLegal, evaluator, alpha, beta, ply + 1);
+	char better = (color == WHITE) ? (value > alpha) : (value < beta);
+	if (better && reduction > 0)
+	{
+		value = zeroWindow(ctx, pos, nextColor, depth - 1, nextLegal, evaluator, alpha, beta, ply + 1);
+		better = (color == WHITE) ? (value > alpha) : (value < beta);
+	}
+	if (better && value > alpha && value < beta)
+		value = searchPosition(ctx, pos, nextColor, depth - 1, nextLegal, evaluator, alpha, beta, ply + 1, &bestIndex);
+	return value;
+}
+
+/*
+ * Search the position after a move with a zero window at the parent's
+ * bound, just above alpha after a white move (color is the side to move
+ * next) or just below beta after a black one.  The value only shows
+ * whether the move beats the bound.
+ */
+static int zeroWindow(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* legalMoves, int evaluator, int alpha, int beta, int ply)
+{
+	int index;
+	if (color == BLACK)
+		return searchPosition(ctx, pos, color, depth, legalMoves, evaluator, alpha, alpha + 1, ply, &index);
+	return searchPosition(ctx, pos, color, depth, legalMoves, evaluator, beta - 1, beta, ply, &index);
+}
+
+/*
+ * Quiescence search at the horizon: the side to move may stand pat on the
+ * position's static score or try its captures and promotions, searched
+ * most valuable victim first, until the position is quiet.  A side in
+ * check has no stand pat and tries all its moves instead, so mates at the
+ * horizon are found.  Moves are generated into the context's set for the
+ * ply before, the one free at a leaf.  Always prunes, so a minimax
+ * search (see setSearchPruning()) calls it with a full window to get the
+ * exact value.  Returns the fail-soft value.
+ */
+static int quiesce(SearchContext* ctx, Position* pos, int color, int evaluator, int alpha, int beta, int ply)
+{
+	int i, best;
+	ctx->nodes++;
+	char inCheck = positionInCheck(pos, color);
+	if (!inCheck || ply >= MAX_PLY - 1)
+	{
+		best = evaluatePosition(pos, evaluator);	//stand pat
+		if (ply >= MAX_PLY - 1)
+			return best;
+		if (color == WHITE)
+		{
+			if (best >= beta)
+				return best;
+			if (best > alpha)
+				alpha = best;
+		} else {
+			if (best <= alpha)
+				return best;
+			if (best < beta)
+				beta = best;
+		}
+	} else {
+		best = (color == WHITE) ? -CHECKMATE_VALUE : CHECKMATE_VALUE;	//unless a move escapes
+	}
+
+	if (ctx->plyMoves[ply - 1] == NULL)
+		ctx->plyMoves[ply - 1] = newMoveSet();
+	MoveSet* moves = ctx->plyMoves[ply - 1];
+	moves->size = 0;
+	if (inCheck)
+		generateLegalMoves(pos, color, UNSCORED, moves);
+	else
+		generateCaptures(pos, color, UNSCORED, moves);
+	orderMoves(ctx, pos, color, moves, 0, ply);
+
+	int nextColor = (color == WHITE) ? BLACK : WHITE;
+	UndoRecord undo;
+	for (i = 0; i < moves->size; i++)
+	{
+		Move* move = getMove(moves, i);
+		executeMove(pos, move, &undo);
+		int value = quiesce(ctx, pos, nextColor, evaluator, alpha, beta, ply + 1);
+		undoMove(pos, move, &undo);
+
+		if (color == WHITE)
+		{
+			if (value > best)
+				best = value;
+			if (best > alpha)
+				alpha = best;
+		} else {
+			if (value < best)
+				best = value;
+			if (best < beta)
+				beta = best;
+		}
+		if (alpha >= beta)
+			break;	//the opponent will avoid this line
+	}
+	return best;
+}
+
+/*
+ * Alpha-beta search below the root on a single position.  Each move is
+ * made and taken back in place; the replies at each ply are generated
+ * into a move set kept for that ply, so the search allocates nothing once
+ * the sets have grown.  Replies are generated without scores and only the
+ * moves reached at depth 0 are evaluated.  Below the root, results are
+ * kept in the transposition table and a stored result that settles the
+ * node ends it early; otherwise the stored best move is searched first.
+ * The calling thread also shares results through the cluster table.
+ * Returns the value and stores
+ * the index of the best move in bestIndex.
+ */
+static int searchPosition(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* legalMoves, int evaluator, int alpha, int beta, int ply, int* bestIndex)
+{
+	int i, best;
+	*bestIndex = 0;
+	char afterNull = ctx->afterNull;	//no second null move in a row
+	ctx->afterNull = FALSE;
+
+	//in a search spread over the nodes, only values inside the root
+	//window matter; if it has closed on this node, any value in between
+	//is a valid fail-soft answer
+	int changes = (ctx->window != NULL) ? ctx->window->changes : 0;
+	narrowWindow(ctx, &alpha, &beta);
+	if (ctx->window != NULL && pruningEnabled && alpha >= beta)
+		return (ctx->window->alpha == alpha) ? alpha : beta;
+
+	int alphaStart = alpha;
+	int betaStart = beta;
+	if (color == WHITE)
+		best = -INFINITY;
+	else
+		best = INFINITY;
+
+	//probe the transposition table below the root, where the move set is
+	//every legal move of the position
+	int hashMove = 0;
+	if (pruningEnabled && ply > 0)
+	{
+		int score, entryDepth, bound;
+		char found;
+		if (ctx == &mainContext)
+			found = probeCluster(tableKey(pos->key, tableEvaluator), depth, &score, &entryDepth, &bound, &hashMove);
+		else
+			found = probeTable(tableKey(pos->key, tableEvaluator), &score, &entryDepth, &bound, &hashMove);
+		if (found)
+		{
+			if (entryDepth >= depth && (bound == EXACT_BOUND ||
+				(bound == LOWER_BOUND && score >= beta) || (bound == UPPER_BOUND && score <= alpha)))
+				return score;
+		} else {
+			hashMove = 0;
+		}
+
+		//search the stored best move first, then the likeliest cutoffs
+		orderMoves(ctx, pos, color, legalMoves, hashMove, ply);
+	}
+
+	if (depth == 0)
+	{
+		//last ply at full width, each move's position is settled by
+		//quiescence search when it is reached
+		int nextColor = (color == WHITE) ? BLACK : WHITE;
+		UndoRecord undo;
+		for (i = 0; i < legalMoves->size; i++)
+		{
+			Move* move = getMove(legalMoves, i);
+			executeMove(pos, move, &undo);
+			int score = pruningEnabled ? quiesce(ctx, pos, nextColor, evaluator, alpha, beta, ply + 1) :
+				quiesce(ctx, pos, nextColor, evaluator, -INFINITY, INFINITY, ply + 1);	//exact value
+			undoMove(pos, move, &undo);
+			if (color == WHITE)
+			{
+				//white
+				if (score > best)
+				{
+					best = score;
+					*bestIndex = i;
+				}
+				if (pruningEnabled && best >= beta)
+				{
+					recordCutoff(ctx, pos, color, move, i, depth, ply);
+					break;	//cutoff, black will avoid this line
+				}
+				if (best > alpha)
+					alpha = best;
+			} else {
+				//black
+				if (score < best)
+				{
+					best = score;
+					*bestIndex = i;
+				}
+				if (pruningEnabled && best <= alpha)
+				{
+					recordCutoff(ctx, pos, color, move, i, depth, ply);
+					break;	//cutoff, white will avoid this line
+				}
+				if (best < beta)
+					beta = best;
+			}
+		}
+		storeResult(ctx, pos, depth, legalMoves, alphaStart, betaStart, ply, best, *bestIndex, changes);
+		return best;
+	}
+
+	if (ctx->plyMoves[ply] == NULL)
+		ctx->plyMoves[ply] = newMoveSet();
+	MoveSet* nextLegal = ctx->plyMoves[ply];
+	int nextColor = (color == WHITE) ? BLACK : WHITE;
+	UndoRecord undo;
+
+	//null move: if passing the turn still fails high on a shallower search,
+	//some move would too, so the node is cut off without searching them
+	if (pruningEnabled && nullMoveEnabled && !afterNull && ply > 0 && depth >= NULL_MIN_DEPTH &&
+		nullMoveSafe(pos, color, alpha, beta))
+	{
+		int reduced = depth - 1 - NULL_REDUCTION;
+		int value = 0;
+		int index;
+		executeNullMove(pos, &undo);
+		nextLegal->size = 0;
+		generateLegalMoves(pos, nextColor, UNSCORED, nextLegal);
+		ctx->nodes++;
+		if (nextLegal->size > 0)
+		{
+			ctx->afterNull = TRUE;
+			if (color == WHITE)
+				value = searchPosition(ctx, pos, nextColor, (reduced > 0) ? reduced : 0, nextLegal, evaluator, beta - 1, beta, ply + 1, &index);
+			else
+				value = searchPosition(ctx, pos, nextColor, (reduced > 0) ? reduced : 0, nextLegal, evaluator, alpha, alpha + 1, ply + 1, &index);
+			ctx->afterNull = FALSE;
+		}
+		undoNullMove(pos, &undo);
+		if ((ctx->stop != NULL && *ctx->stop) || splitCut(ctx->split))
+			return best;	//abandoned, the value is not used
+		if (nextLegal->size > 0 && color == WHITE && value >= beta)
+			return beta;	//not a proven mate, so only the bound
+		if (nextLegal->size > 0 && color == BLACK && value <= alpha)
+			return alpha;
+	}
+
+	//recursively search each next legal move for the one
+	//that leads to the best end case
+	char inCheck = (depth >= LMR_MIN_DEPTH) && positionInCheck(pos, color);
+	for (i = 0; i < legalMoves->size; i++)
+	{
+		if ((ctx->stop != NULL && *ctx->stop) || splitCut(ctx->split))
+			return best;	//abandoned, the value is not used
+
+		Move* testMove = getMove(legalMoves, i);	//get move from the set of legal moves
+		char quiet = (captureRank(pos, testMove) == 0);
+		executeMove(pos, testMove, &undo);	//execute it
+		nextLegal->size = 0;
+		generateLegalMoves(pos, nextColor, UNSCORED, nextLegal);	//get the next set of legal moves, scored later if needed
+		ctx->nodes++;
+		if (ctx->poll != NULL && ctx->nodes % POLL_NODES == 0)
+			ctx->poll(ctx->pollData);
+
+		int value, index;
+		if (nextLegal->size == 0)
+		{
+			//no legal moves available, either a checkmate or stalemate
+			if (!positionInCheck(pos, nextColor))
+				value = 0;	//stalemate
+			else if (color == WHITE)
+				value = CHECKMATE_VALUE;	//black's king in checkmate
+			else
+				value = -CHECKMATE_VALUE;	//white's king in checkmate
+		} else if (i == 0 || !pruningEnabled) {
+			//recurse
+			value = searchPosition(ctx, pos, nextColor, depth - 1, nextLegal, evaluator, alpha, beta, ply + 1, &index);
+		} else {
+			value = searchLaterMove(ctx, pos, color, depth, nextLegal, evaluator, alpha, beta, ply, testMove, i, quiet, inCheck);
+		}
+		undoMove(pos, testMove, &undo);
+
+		if (color == WHITE)
+		{
+			//white
+			if (value > best)
+			{
+				//update current best move found
+				*bestIndex = i;
+				best = value;
+			}
+			if (best > alpha)
+				alpha = best;
+		} else {
+			//black
+			if (value < best)
+			{
+				//update current best move found
+				*bestIndex = i;
+				best = value;
+			}
+			if (best < beta)
+				beta = best;
+		}
+		narrowWindow(ctx, &alpha, &beta);
+
+		//stop searching siblings once the opponent can avoid this line
+		if (pruningEnabled && alpha >= beta)
+		{
+			recordCutoff(ctx, pos, color, testMove, i, depth, ply);
+			break;
+		}
+
+		//with the eldest brother searched, idle threads may take the rest,
+		//or other nodes when this one has no other thread
+		if (i == 0 && ctx->worker != 0 && depth >= ((splitPool.workers > 1) ? SPLIT_DEPTH : REMOTE_SPLIT_DEPTH) &&
+			legalMoves->size > 1)
+		{
+			best = splitNode(ctx, pos, color, depth, legalMoves, evaluator, alpha, beta, ply, best, bestIndex);
+			break;
+		}
+	}
+
+	storeResult(ctx, pos, depth, legalMoves, alphaStart, betaStart, ply, best, *bestIndex, changes);
+	return best;
+}
+
+/*
+ * Lazy SMP helper thread.  Searches the root position at increasing
+ * depths, sharing results through the transposition table, until the
+ * main thread sets the stop flag.
+ */
+static void* helperSearch(void* arg)
+{
+	HelperJob* job = (HelperJob*) arg;
+	SearchContext* ctx = &job->context;
+	int depth, index;
+
+	for (depth = job->depth; depth < MAX_PLY && !*ctx->stop; depth++)
+		searchPosition(ctx, &job->pos, job->color, depth, job->moves, job->evaluator, -INFINITY, INFINITY, 0, &index);
+	return NULL;
+}
+
+/*
+ * Search from the root with several threads in this process (Lazy SMP).
+ * The calling thread searches the given depth and its result is returned.
+ * Helper threads search the same position with the root moves rotated,
+ * every other one a ply deeper, and share what they find through the
+ * transposition table.  They stop when the calling thread finishes.
+ * Only the calling thread uses the window, root window, poll hook and
+ * stop flag of a search spread over the nodes, and only it makes MPI
+ * calls; the helpers search with a full window.  With setSplitSearch()
+ * the threads split the tree instead, see bestMoveSplit(), and a search
+ * spread over the nodes splits it even with one thread, for the other
+ * nodes to steal from.
+ */
+MoveDef* bestMoveThreaded(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta, int threads)
+{
+	char remoteSplit = (splitSearch && COMM_WORLD.Get_size() > 1);	//other nodes may steal moves
+	if ((threads <= 1 && !remoteSplit) || depth == 0 || !pruningEnabled)
+		return bestMoveHelper(board, color, depth, legalMoves, prevMove, evaluator, alpha, beta);
+	if (splitSearch)
+		return bestMoveSplit(board, color, depth, legalMoves, prevMove, evaluator, alpha, beta, threads);
+
+	volatile char stop = FALSE;
+	HelperJob* jobs = (HelperJob*) calloc(threads - 1, sizeof(HelperJob));
+	int t, i;
+
+	useEvaluator(evaluator);
+
+	for (t = 0; t < threads - 1; t++)
+	{
+		HelperJob* job = &jobs[t];
+		job->context.stop = &stop;
+		loadPosition(board, color, prevMove, &job->pos);
+		job->color = color;
+		job->depth = depth + (t % 2 == 0 ? 1 : 0);
+		job->evaluator = evaluator;
+		job->moves = newMoveSet();
+		for (i = 0; i < legalMoves->size; i++)
+		{
+			Move* move = getMove(legalMoves, (i + t + 1) % legalMoves->size);
+			addMove(job->moves, move->pieceId, move->startRow, move->startCol, move->endRow, move->endCol, move->boardScore);
+		}
+		pthread_create(&job->thread, NULL, helperSearch, job);
+	}
+
+	MoveDef* best = bestMoveHelper(board, color, depth, legalMoves, prevMove, evaluator, alpha, beta);
+
+	stop = TRUE;
+	for (t = 0; t < threads - 1; t++)
+	{
+		pthread_join(jobs[t].thread, NULL);
+		collectCounts(&jobs[t].context);
+		for (i = 0; i < MAX_PLY; i++)
+			if (jobs[t].context.plyMoves[i] != NULL)
+				destroyMoveSet(jobs[t].context.plyMoves[i]);
+		destroyMoveSet(jobs[t].moves);
+	}
+	free(jobs);
+	return best;
+}
+
+/*
+ * Returns TRUE if the search under a split point has been abandoned: the
+ * split point or one above it failed high, or its owner was stopped.
+ */
+static char splitCut(SplitPoint* sp)
+{
+	for (; sp != NULL; sp = sp->parent)
+	{
+		if (sp->cutoff || (sp->stop != NULL && *sp->stop))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * Take the next move of a split point to search, with the window to
+ * search it in.  Returns FALSE if none are left.  The caller holds the
+ * split point's lock.
+ */
+static char takeSplitMove(SplitPoint* sp, int* index, int* alpha, int* beta)
+{
+	if (sp->cutoff || sp->next >= sp->moves->size)
+		return FALSE;
+	*index = sp->next++;
+	*alpha = sp->alpha;
+	*beta = sp->beta;
+	sp->working++;
+	return TRUE;
+}
+
+/*
+ * Search one move of a split point's node, index in its ordering, on a
+ * copy of the node's position, and return its value.  Like the node's
+ * later moves searched in order, it is searched by searchLaterMove().
+ */
+static int searchSplitChild(SearchContext* ctx, Position* nodePos, int color, int depth, int evaluator, int ply, Move* move, int index, int alpha, int beta)
+{
+	Position pos = *nodePos;
+	UndoRecord undo;
+	int nextColor = (color == WHITE) ? BLACK : WHITE;
+	int value;
+
+	if (ctx->plyMoves[ply] == NULL)
+		ctx->plyMoves[ply] = newMoveSet();
+	MoveSet* nextLegal = ctx->plyMoves[ply];
+	char inCheck = positionInCheck(&pos, color);
+	char quiet = (captureRank(&pos, move) == 0);
+	executeMove(&pos, move, &undo);
+	nextLegal->size = 0;
+	generateLegalMoves(&pos, nextColor, UNSCORED, nextLegal);
+	ctx->nodes++;
+	if (ctx->poll != NULL && ctx->nodes % POLL_NODES == 0)
+		ctx->poll(ctx->pollData);
+
+	if (nextLegal->size == 0)
+	{
+		//no legal moves available, either a checkmate or stalemate
+		if (!positionInCheck(&pos, nextColor))
+			value = 0;	//stalemate
+		else if (color == WHITE)
+			value = CHECKMATE_VALUE;	//black's king in checkmate
+		else
+			value = -CHECKMATE_VALUE;	//white's king in checkmate
+	} else {
+		value = searchLaterMove(ctx, &pos, color, depth, nextLegal, evaluator, alpha, beta, ply, move, index, quiet, inCheck);
+	}
+	return value;
+}
+
+/*
+ * Search one move of a split point on a copy of its position, and fold
+ * the value into the split point.
+ */
+static void searchSplitMove(SearchContext* ctx, SplitPoint* sp, int index, int alpha, int beta)
+{
+	SplitPoint* outer = ctx->split;
+	ctx->split = sp;
+	int value = searchSplitChild(ctx, &sp->pos, sp->color, sp->depth, sp->evaluator, sp->ply, getMove(sp->moves, index), index, alpha, beta);
+	ctx->split = outer;
+	foldSplitValue(sp, index, value);
+}
+
+/*
+ * Fold the value of a split point's move, searched here or on another
+ * node, into the split point unless the search was abandoned.
+ */
+static void foldSplitValue(SplitPoint* sp, int index, int value)
+{
+	pthread_mutex_lock(&sp->lock);
+	if (!splitCut(sp))
+	{
+		if (sp->color == WHITE)
 		{
-			Move* move = getMove(legalMoves, i);
-			if (color == WHITE)
+			if (value > sp->best)
 			{
-				//white
-				if (move->boardScore > best)
-					best = move->boardScore;	//update best move
-			} else {
-				//black
-				if (move->boardScore < best)
-					best = move->boardScore;	//update best move
+				sp->best = value;
+				sp->bestIndex = index;
+			}
+			if (sp->best > sp->alpha)
+				sp->alpha = sp->best;
+		} else {
+			if (value < sp->best)
+			{
+				sp->best = value;
+				sp->bestIndex = index;
 			}
+			if (sp->best < sp->beta)
+				sp->beta = sp->best;
 		}
-		
-		//choose random best move if multiple close to best
-		int icount = 0;
-		int* indices = (int*) malloc(sizeof(int) * legalMoves->size);
-		for (i = 0; i < legalMoves->size; i++)
+		if (sp->alpha >= sp->beta)
+			sp->cutoff = TRUE;
+	}
+	sp->working--;
+	pthread_mutex_unlock(&sp->lock);
+}
+
+/*
+ * Search the remaining moves of a node whose first move has been searched
+ * (Young Brothers Wait).  The node becomes a split point on the thread's
+ * deque, from which idle threads steal moves, while the thread searches
+ * moves from it too.  Once no moves are left to hand out, the thread waits
+ * for the ones being searched elsewhere.  Returns the node's value and
+ * stores the index of the best move in bestIndex.
+ */
+static int splitNode(SearchContext* ctx, Position* pos, int color, int depth, MoveSet* legalMoves, int evaluator, int alpha, int beta, int ply, int best, int* bestIndex)
+{
+	SplitPoint sp;
+	int index, moveAlpha, moveBeta;
+	pthread_mutex_init(&sp.lock, NULL);
+	sp.parent = ctx->split;
+	sp.stop = ctx->stop;
+	sp.pos = *pos;
+	sp.color = color;
+	sp.depth = depth;
+	sp.evaluator = evaluator;
+	sp.ply = ply;
+	sp.moves = legalMoves;
+	sp.next = 1;
+	sp.working = 0;
+	sp.alpha = alpha;
+	sp.beta = beta;
+	sp.best = best;
+	sp.bestIndex = *bestIndex;
+	sp.cutoff = FALSE;
+
+	int worker = ctx->worker - 1;
+	pthread_mutex_lock(&splitPool.lock);
+	splitPool.deques[worker][splitPool.dequeSizes[worker]++] = &sp;
+	pthread_mutex_unlock(&splitPool.lock);
+
+	while (!splitCut(sp.parent))
+	{
+		pthread_mutex_lock(&sp.lock);
+		char taken = takeSplitMove(&sp, &index, &moveAlpha, &moveBeta);
+		pthread_mutex_unlock(&sp.lock);
+		if (!taken)
+			break;
+		searchSplitMove(ctx, &sp, index, moveAlpha, moveBeta);
+	}
+
+	//no thief can reach the split point once it is off the deque
+	pthread_mutex_lock(&splitPool.lock);
+	splitPool.dequeSizes[worker]--;
+	pthread_mutex_unlock(&splitPool.lock);
+	while (TRUE)
+	{
+		pthread_mutex_lock(&sp.lock);
+		int working = sp.working;
+		pthread_mutex_unlock(&sp.lock);
+		if (working == 0)
+			break;
+		if (ctx->poll != NULL)
+			ctx->poll(ctx->pollData);
+		sched_yield();
+	}
+
+	pthread_mutex_destroy(&sp.lock);
+	*bestIndex = sp.bestIndex;
+	return sp.best;
+}
+
+/*
+ * Steal a move from another thread's oldest split point with moves left.
+ * Returns the split point, or NULL if there is nothing to steal.
+ */
+static SplitPoint* stealSplitMove(int thief, int* index, int* alpha, int* beta)
+{
+	int v, k;
+	pthread_mutex_lock(&splitPool.lock);
+	for (v = 1; v < splitPool.workers; v++)
+	{
+		int victim = (thief + v) % splitPool.workers;
+		for (k = 0; k < splitPool.dequeSizes[victim]; k++)
 		{
-			Move* move = getMove(legalMoves, i);
-			if (abs(best - move->boardScore) <= RAND_RANGE)
-				indices[icount++] = i;
+			SplitPoint* sp = splitPool.deques[victim][k];
+			pthread_mutex_lock(&sp->lock);
+			char taken = !splitCut(sp) && takeSplitMove(sp, index, alpha, beta);
+			pthread_mutex_unlock(&sp->lock);
+			if (taken)
+			{
+				pthread_mutex_unlock(&splitPool.lock);
+				return sp;
+			}
 		}
-		
-		MoveDef* m = (MoveDef*) malloc(sizeof(MoveDef));
-		if (icount == 0)
-			m->index = indices[0];
+	}
+	pthread_mutex_unlock(&splitPool.lock);
+	return NULL;
+}
+
+/*
+ * YBW worker thread: steal moves from split points until the search is
+ * over.
+ */
+static void* splitWorker(void* arg)
+{
+	SplitWorker* worker = (SplitWorker*) arg;
+	SearchContext* ctx = &worker->context;
+	int index, alpha, beta;
+	while (!splitPool.stop)
+	{
+		SplitPoint* sp = stealSplitMove(ctx->worker - 1, &index, &alpha, &beta);
+		if (sp != NULL)
+			searchSplitMove(ctx, sp, index, alpha, beta);
 		else
-			m->index = indices[(int) rand() % icount];
-		m->value = best;
-		free(indices);
-		
-		return m;
-	} else {
-		//recursive case
-		//execute each move and recurse
-		int i;
-		
-		//declare variables for the next move and an empty board
-		char* nextBoard = buildNewBoard();
-		MoveSet* nextLegal;
-		char nextColor;
-		
-		//initialize variables, best holds the "best" next move
-		MoveDef* best;
-		best = (MoveDef*) malloc(sizeof(MoveDef));
-		best->index = 0;
-		if (color == WHITE)
+			sched_yield();
+	}
+	return NULL;
+}
+
+/*
+ * Search from the root with several threads in this process, splitting
+ * the tree (Young Brothers Wait).  At each node at least SPLIT_DEPTH from
+ * the leaves, the first move is searched alone to establish a bound, and
+ * the rest can then be stolen by idle threads.  The calling thread runs
+ * the search and its context is used as in bestMoveThreaded().
+ */
+static MoveDef* bestMoveSplit(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta, int threads)
+{
+	SplitWorker* workers = startSplitPool(threads);
+	MoveDef* best = bestMoveHelper(board, color, depth, legalMoves, prevMove, evaluator, alpha, beta);
+	stopSplitPool(workers);
+	return best;
+}
+
+/*
+ * Start the worker threads of a YBW search, the calling thread being the
+ * first of the given number.  Returns the others, for stopSplitPool().
+ */
+static SplitWorker* startSplitPool(int threads)
+{
+	int t;
+	if (threads > MAX_WORKERS)
+		threads = MAX_WORKERS;
+	SplitWorker* workers = (SplitWorker*) calloc(threads - 1, sizeof(SplitWorker));
+	pthread_mutex_init(&splitPool.lock, NULL);
+	splitPool.workers = threads;
+	splitPool.stop = FALSE;
+	for (t = 0; t < threads; t++)
+		splitPool.dequeSizes[t] = 0;
+
+	mainContext.worker = 1;
+	for (t = 0; t < threads - 1; t++)
+	{
+		workers[t].context.worker = t + 2;
+		pthread_create(&workers[t].thread, NULL, splitWorker, &workers[t]);
+	}
+	return workers;
+}
+
+/*
+ * Stop the worker threads started by startSplitPool() once the calling
+ * thread's search is over, and collect their counts.
+ */
+static void stopSplitPool(SplitWorker* workers)
+{
+	int t, i;
+	splitPool.stop = TRUE;
+	mainContext.worker = 0;
+	for (t = 0; t < splitPool.workers - 1; t++)
+	{
+		pthread_join(workers[t].thread, NULL);
+		collectCounts(&workers[t].context);
+		for (i = 0; i < MAX_PLY; i++)
+			if (workers[t].context.plyMoves[i] != NULL)
+				destroyMoveSet(workers[t].context.plyMoves[i]);
+	}
+	splitPool.workers = 0;	//no split points left to hand to other nodes
+	pthread_mutex_destroy(&splitPool.lock);
+	free(workers);
+}
+
+/*
+ * Handle messages from nodes stealing split point moves from this one:
+ * hand over a move of the oldest split point deep enough, or take back a
+ * stolen move's value.  Thieves whose split points were cut off since
+ * are told to stop.  Every node serves steals while searching and while
+ * waiting for messages, see waitMessage(); only the thread making MPI
+ * calls may do so.
+ */
+static void serveSteals()
+{
+	int numProcs = COMM_WORLD.Get_size();
+	int node;
+	Status status;
+	if (remoteMoves == NULL)
+		remoteMoves = (RemoteMove*) calloc(numProcs, sizeof(RemoteMove));
+
+	while (COMM_WORLD.Iprobe(ANY_SOURCE, VICTIM_TAG, status))
+	{
+		StealMessage message;
+		node = status.Get_source();
+		COMM_WORLD.Recv(&message, sizeof(StealMessage), BYTE, node, VICTIM_TAG);
+		RemoteMove* remote = &remoteMoves[node];
+		if (message.type == STEAL_RESULT)
 		{
-			nextColor = BLACK;
-			best->value = -INFINITY;
-		} else {
-			nextColor = WHITE;
-			best->value = INFINITY;
+			foldSplitValue(remote->sp, remote->index, message.value);
+			remote->sp = NULL;
+			continue;
 		}
-		
-		//recursively search each next legal move for the one
-		//that leads to the best end case
-		for (i = 0; i < legalMoves->size; i++)
+
+		//hand over a move, from the oldest split point of any thread
+		int w, k;
+		message.type = STEAL_NONE;
+		if (splitPool.workers > 0)
 		{
-			cloneBoard(board, nextBoard);	//copy board
-			Move* testMove = getMove(legalMoves, i);	//get move from the set of legal moves
-			executeMove(nextBoard, testMove, prevMove);	//execute it
-			nextLegal = getLegalMoves(nextBoard, nextColor, testMove, evaluator);	//get the next set of legal moves available
-			MoveDef* m;
-			if (nextLegal->size == 0)
+			pthread_mutex_lock(&splitPool.lock);
+			for (w = 0; w < splitPool.workers && message.type == STEAL_NONE; w++)
 			{
-				//no legal moves available, either a checkmate or stalemate
-				m = (MoveDef*) malloc(sizeof(MoveDef));
-				m->index = 0;
-				if (color == WHITE)
+				for (k = 0; k < splitPool.dequeSizes[w]; k++)
 				{
-					//check for stalemate
-					if (kingInCheck(nextBoard, BLACK))
-					{
-						m->value = CHECKMATE_VALUE;	//black's king in checkmate
-					} else {
-						m->value = 0;	//stalemate
-					}
-				} else {
-					//check for stalemate
-					if (kingInCheck(nextBoard, WHITE))
+					SplitPoint* sp = splitPool.deques[w][k];
+					if (sp->depth < REMOTE_SPLIT_DEPTH)
+						continue;
+					pthread_mutex_lock(&sp->lock);
+					char taken = !splitCut(sp) && takeSplitMove(sp, &remote->index, &message.alpha, &message.beta);
+					pthread_mutex_unlock(&sp->lock);
+					if (taken)
 					{
-						m->value = -CHECKMATE_VALUE;	//white's king in checkmate
-					} else {
-						m->value = 0;	//stalemate
+						remote->sp = sp;
+						remote->steal = message.steal;
+						remote->cancelled = FALSE;
+						message.type = STEAL_MOVE;
+						message.color = sp->color;
+						message.depth = sp->depth;
+						message.ply = sp->ply;
+						message.evaluator = sp->evaluator;
+						message.index = remote->index;
+						message.move = *getMove(sp->moves, remote->index);
+						message.pos = sp->pos;
+						break;
 					}
 				}
-			} else {
-				//recurse
-				m = bestMoveHelper(nextBoard, nextColor, depth - 1, nextLegal, testMove, evaluator);
 			}
+			pthread_mutex_unlock(&splitPool.lock);
+		}
+		COMM_WORLD.Send(&message, sizeof(StealMessage), BYTE, node, THIEF_TAG);
+	}
 
-			if (color == WHITE)
-			{
-				//white
-				if (m->value > best->value)
-				{
-					//update current best move found
-					best->index = i;
-					best->value = m->value;
-				}
-			} else {
-				//black
-				if (m->value < best->value)
-				{
-					//update current best most found
-					best->index = i;
-					best->value = m->value;
-				}
-			}
-			
-			//free memory
-			free(m);
-			destroyMoveSet(nextLegal);
+	for (node = 0; node < numProcs; node++)
+	{
+		RemoteMove* remote = &remoteMoves[node];
+		if (remote->sp != NULL && !remote->cancelled && splitCut(remote->sp))
+		{
+			StealMessage cancel;
+			cancel.type = STEAL_CANCEL;
+			cancel.steal = remote->steal;
+			COMM_WORLD.Send(&cancel, sizeof(StealMessage), BYTE, node, THIEF_TAG);
+			remote->cancelled = TRUE;
+		}
+	}
+}
+
+/*
+ * Wait for a message, serving nodes stealing from this one meanwhile if
+ * threads split the tree.  The caller then receives it.
+ */
+static void waitMessage(int source, int tag)
+{
+	if (!splitSearch)
+		return;	//nothing to serve, the receive waits
+	while (!COMM_WORLD.Iprobe(source, tag))
+	{
+		serveSteals();
+		sched_yield();
+	}
+}
+
+/*
+ * Search poll hook for a node searching a stolen move: serve the nodes
+ * stealing from this one, and stop if the victim cancels the move.
+ * Cancels of moves stolen before are ignored.
+ */
+static void pollVictim(void* data)
+{
+	StolenMove* stolen = (StolenMove*) data;
+	serveSteals();
+	while (COMM_WORLD.Iprobe(stolen->victim, THIEF_TAG))
+	{
+		StealMessage message;
+		COMM_WORLD.Recv(&message, sizeof(StealMessage), BYTE, stolen->victim, THIEF_TAG);
+		if (message.type == STEAL_CANCEL && message.steal == stolen->steal)
+			stolen->stop = TRUE;
+	}
+}
+
+/*
+ * Steal a move from one of a victim node's split points, search it with
+ * this node's threads, and send its value back.  The move's own split
+ * points may be stolen from in turn.  Returns FALSE if the victim had no
+ * move to hand over.
+ */
+static char stealRemoteMove(int victim)
+{
+	StealMessage message;
+	message.type = STEAL_REQUEST;
+	message.steal = ++stealCount;
+	COMM_WORLD.Send(&message, sizeof(StealMessage), BYTE, victim, VICTIM_TAG);
+	do
+	{
+		waitMessage(victim, THIEF_TAG);
+		COMM_WORLD.Recv(&message, sizeof(StealMessage), BYTE, victim, THIEF_TAG);
+	} while (message.type == STEAL_CANCEL);	//for a move stolen before
+	if (message.type == STEAL_NONE)
+		return FALSE;
+
+	StolenMove stolen;
+	stolen.victim = victim;
+	stolen.steal = message.steal;
+	stolen.stop = FALSE;
+	mainContext.poll = pollVictim;
+	mainContext.pollData = &stolen;
+	mainContext.stop = &stolen.stop;
+	useEvaluator(message.evaluator);
+	SplitWorker* workers = startSplitPool(nodeThreads);
+	message.value = searchSplitChild(&mainContext, &message.pos, message.color, message.depth, message.evaluator,
+		message.ply, &message.move, message.index, message.alpha, message.beta);
+	stopSplitPool(workers);
+	collectCounts(&mainContext);
+	mainContext.poll = NULL;
+	mainContext.stop = NULL;
+
+	//the victim ignores the value of a cancelled move
+	message.type = STEAL_RESULT;
+	COMM_WORLD.Send(&message, sizeof(StealMessage), BYTE, victim, VICTIM_TAG);
+	return TRUE;
+}
+
+/*
+ * Fill in the late move reduction table: the reduction grows with the
+ * logarithms of the depth and of the move's place in the ordering, and
+ * always leaves at least one ply to search.
+ */
+void initSearch()
+{
+	int depth, index;
+	for (depth = 0; depth < MAX_PLY; depth++)
+	{
+		for (index = 0; index < MAX_MOVES; index++)
+		{
+			int reduction = (depth > 0 && index > 0) ? (int) (0.75 + __builtin_log(depth) * __builtin_log(index + 1) / 2.25) : 0;
+			if (reduction > depth - 2)
+				reduction = (depth > 2) ? depth - 2 : 0;
+			reductions[depth][index] = (char) reduction;
 		}
-		
-		//free memory
-		free(nextBoard);
-		
-		//restore castling variables
-		whiteKCastleInvalid = tmpWKC;
-		whiteQCastleInvalid = tmpWQC;
-		blackKCastleInvalid = tmpBKC;
-		blackQCastleInvalid = tmpBQC;
-		
-		//return best index
-		return best;
 	}
 }
 
+/* Set the number of threads bestMove() searches with on a single node. */
+void setSearchThreads(int threads)
+{
+	searchThreads = threads;
+}
+
+/* Search with several threads by splitting the tree (TRUE) or by Lazy
+ * SMP (FALSE), see bestMoveThreaded(). */
+void setSplitSearch(char enabled)
+{
+	splitSearch = enabled;
+}
+
+/* Set the number of threads each node searches its root moves with when
+ * bestMove() spreads the search over several nodes. */
+void setNodeThreads(int threads)
+{
+	nodeThreads = threads;
+}
+
+/* Enable or disable alpha-beta cutoffs (disabled gives plain minimax). */
+void setSearchPruning(char enabled)
+{
+	pruningEnabled = enabled;
+}
+
+/* Enable or disable late move reductions, which can change the search's
+ * values where a late quiet move turns out best only when searched deeper
+ * than its reduced depth. */
+void setMoveReductions(char enabled)
+{
+	reductionsEnabled = enabled;
+}
+
+/* Enable or disable null-move pruning, which can change the search's
+ * values where passing the turn would be best (zugzwang). */
+void setNullMovePruning(char enabled)
+{
+	nullMoveEnabled = enabled;
+}
+
+/* Get the number of positions visited by the search since the last reset. */
+long getSearchNodes()
+{
+	return searchNodes;
+}
+
+/* Reset the search node and cutoff counters. */
+void resetSearchNodes()
+{
+	searchNodes = 0;
+	searchCutoffs = 0;
+	firstCutoffs = 0;
+}
+
+/* Nodes cut off by a move that failed high since the counters were last
+ * reset, and how many of them by the first move searched. */
+void getCutoffCounts(long* cutoffs, long* first)
+{
+	*cutoffs = searchCutoffs;
+	*first = firstCutoffs;
+}
+
+/*
+ * Sum the search counters of every node onto the head node and reset
+ * them: nodes searched, remote cluster table probes and the probes that
+ * found a result.  Every node must call it.
+ */
+void sumSearchCounts(long* counts)
+{
+	long local[3];
+	local[0] = searchNodes;
+	getClusterCounts(&local[1], &local[2]);
+	searchNodes = 0;
+	COMM_WORLD.Reduce(local, counts, 3, LONG, SUM, HEAD);
+}
+
+/* Get the four castling flags packed into one value. */
+char getCastleFlags()
+{
+	char flags = 0;
+	if (whiteKCastleInvalid)
+		flags |= WHITE_KCASTLE_INVALID;
+	if (whiteQCastleInvalid)
+		flags |= WHITE_QCASTLE_INVALID;
+	if (blackKCastleInvalid)
+		flags |= BLACK_KCASTLE_INVALID;
+	if (blackQCastleInvalid)
+		flags |= BLACK_QCASTLE_INVALID;
+	return flags;
+}
+
+/* Set the four castling flags from a value packed by getCastleFlags(). */
+void setCastleFlags(char flags)
+{
+	whiteKCastleInvalid = (flags & WHITE_KCASTLE_INVALID) != 0;
+	whiteQCastleInvalid = (flags & WHITE_QCASTLE_INVALID) != 0;
+	blackKCastleInvalid = (flags & BLACK_KCASTLE_INVALID) != 0;
+	blackQCastleInvalid = (flags & BLACK_QCASTLE_INVALID) != 0;
+}
+
+/* Returns true if black may no longer castle. */
+char blackCastleInvalid()
+{
+	return blackKCastleInvalid && blackQCastleInvalid;
+}
+
+/* Returns true if white may no longer castle. */
+char whiteCastleInvalid()
+{
+	return whiteKCastleInvalid && whiteQCastleInvalid;
+}
+
+/* Set castling validity for both of black's sides. */
+void setBlackCastleInvalid(char validity)
+{
+	blackKCastleInvalid = validity;
+	blackQCastleInvalid = validity;
+}
+
+/* Set castling validity for both of white's sides. */
+void setWhiteCastleInvalid(char validity)
+{
+	whiteKCastleInvalid = validity;
+	whiteQCastleInvalid = validity;
+}
+
 /* Create a new move struct. */
 Move* newMove()
 {
@@ -2925,6 +5386,7 @@ Move* newMove()
 	m->startCol = -1;
 	m->endCol = -1;
 	m->boardScore = 0;
+	return m;
 }
 
 /* Create a new move struct. */
@@ -2956,114 +5418,119 @@ Move* cloneMove(Move* m)
 /*
  * Returns a subset of a MoveSet structure.  Starts at
  * the move indexed by "start" and pulls out "length"
- * moves.
+ * moves.  The subset shares the moves of the original
+ * set, so only the returned structure should be freed.
  */
 MoveSet* subMoveSet(MoveSet* set, int start, int length)
 {
-	int i, j;
 	MoveSet* s = (MoveSet*) malloc(sizeof(MoveSet));
 	s->size = length;
 	s->cap = length;
-	s->moves = (Move**) malloc(sizeof(Move*) * length);
-	
-	for (j = 0, i = start; j < length; i++, j++)
-		s->moves[j] = set->moves[i];
+	s->moves = set->moves + start;
 	return s;
 }
 
-/* Send part of a MoveSet structure to another node. */
-void sendMoveSet(int receiver, MoveSet* set)
+/*
+ * Broadcast a command from the head node to every slave node, or receive
+ * one on a slave node.  A command is COMMAND_SIZE ints, the first being
+ * the command type.
+ */
+void broadcastCommand(int* command)
 {
-	//Send set size
-	int i;
-	int size = set->size;
-	COMM_WORLD.Send(&size, 1, MPI_INT, receiver, 0);
-	
-	//Send move data
-	for (i = 0; i < size; i++)
-	{
-		COMM_WORLD.Send(&set->moves[i]->pieceId, 1, MPI_CHAR, receiver, 0);
-		COMM_WORLD.Send(&set->moves[i]->startRow, 1, MPI_CHAR, receiver, 0);
-		COMM_WORLD.Send(&set->moves[i]->startCol, 1, MPI_CHAR, receiver, 0);
-		COMM_WORLD.Send(&set->moves[i]->endRow, 1, MPI_CHAR, receiver, 0);
-		COMM_WORLD.Send(&set->moves[i]->endCol, 1, MPI_CHAR, receiver, 0);
-		COMM_WORLD.Send(&set->moves[i]->boardScore, 1, MPI_INT, receiver, 0);
-	}
+	COMM_WORLD.Bcast(command, COMMAND_SIZE, MPI_INT, HEAD);
 }
 
-/* Receive a MoveSet structure from the head node. */
-MoveSet* receiveMoveSet()
+/*
+ * Broadcast a move played on the head node's board.
+ */
+void broadcastMove(Move* move)
 {
-	//Get set size
-	int i;
-	int size;
-	COMM_WORLD.Recv(&size, 1, MPI_INT, HEAD, 0);
-	
-	//Allocate MoveSet structure
-	MoveSet* set = (MoveSet*) malloc(sizeof(MoveSet));
-	set->size = size;
-	set->cap = size;
-	set->moves  = (Move**) malloc(sizeof(Move*) * size);
-	
-	//Receive move data
-	for (i = 0; i < size; i++)
-	{
-		Move* m = (Move*) malloc(sizeof(Move));
-		COMM_WORLD.Recv(&m->pieceId, 1, MPI_CHAR, HEAD, 0);
-		COMM_WORLD.Recv(&m->startRow, 1, MPI_CHAR, HEAD, 0);
-		COMM_WORLD.Recv(&m->startCol, 1, MPI_CHAR, HEAD, 0);
-		COMM_WORLD.Recv(&m->endRow, 1, MPI_CHAR, HEAD, 0);
-		COMM_WORLD.Recv(&m->endCol, 1, MPI_CHAR, HEAD, 0);
-		COMM_WORLD.Recv(&m->boardScore, 1, MPI_INT, HEAD, 0);
-		set->moves[i] = m;
-	}
-	
-	//Return MoveSet
-	return set;
+	int command[COMMAND_SIZE] = {PLAY_COMMAND, move->pieceId, move->startRow, move->startCol, move->endRow, move->endCol};
+	broadcastCommand(command);
 }
 
-/* Sends best move to head node. */
-void sendMoveDef(MoveDef* best)
+/*
+ * Slave node side of a search.  The legal moves are generated from the
+ * node's copy of the game, in the same order as on the head node, and
+ * each job names a unit to search: a root move, or a root move and one
+ * of the replies to it.  key is the head node's
+ * position key, to check the copy against.  A job with a negative index
+ * ends the search.  While a job is searched the head node may send
+ * BOUND_JOB and CANCEL_JOB messages, read by pollHead().  Once no units
+ * are left, the head sends STEAL_JOB jobs instead.
+ */
+void serveSearch(char* board, int color, Move* prevMove, int depth, int evaluator, Bitboard key)
 {
-	int bestIndex = best->index;
-	int bestValue = best->value;
-	COMM_WORLD.Send(&bestIndex, 1, MPI_INT, HEAD, 0);
-	COMM_WORLD.Send(&bestValue, 1, MPI_INT, HEAD, 0);
-}
+	MoveSet* legalMoves = getLegalMoves(board, color, prevMove, evaluator);
+	int job[JOB_SIZE];
 
-/* Receive best move from slave node. */
-MoveDef* receiveMoveDef(int sender)
-{
-	int bestIndex;
-	int bestValue;
-	COMM_WORLD.Recv(&bestIndex, 1, MPI_INT, sender, 0);
-	COMM_WORLD.Recv(&bestValue, 1, MPI_INT, sender, 0);
-	MoveDef* best = (MoveDef*) malloc(sizeof(MoveDef));
-	best->index = bestIndex;
-	best->value = bestValue;
-	return best;
-}
+	//the copy of the game must match the head node's, castling and en passant included
+	Position pos;
+	loadPosition(board, color, prevMove, &pos);
+	if (pos.key != key)
+		printf("NODE %d: POSITION DIFFERS FROM THE HEAD NODE'S.\n", COMM_WORLD.Get_rank());
 
-/* Send a Move structure to a slave node. */
-void sendMove(int receiver, Move* move)
-{
-	COMM_WORLD.Send(&move->pieceId, 1, MPI_CHAR, receiver, 0);
-	COMM_WORLD.Send(&move->startRow, 1, MPI_CHAR, receiver, 0);
-	COMM_WORLD.Send(&move->startCol, 1, MPI_CHAR, receiver, 0);
-	COMM_WORLD.Send(&move->endRow, 1, MPI_CHAR, receiver, 0);
-	COMM_WORLD.Send(&move->endCol, 1, MPI_CHAR, receiver, 0);
-	COMM_WORLD.Send(&move->boardScore, 1, MPI_INT, receiver, 0);
+	while (TRUE)
+	{
+		waitMessage(HEAD, 0);
+		COMM_WORLD.Recv(job, JOB_SIZE, MPI_INT, HEAD, 0);
+		if (job[0] == CANCEL_JOB)
+			continue;	//for a job already finished
+		if (job[0] == BOUND_JOB)
+			continue;	//the next job's window already includes it
+		if (job[0] == STEAL_JOB)
+		{
+			//search a move of another node's split point, if it has one
+			MoveDef stolen;
+			long stealNodes = searchNodes;
+			stolen.index = STEALING;
+			stolen.value = stealRemoteMove(job[1]);
+			sendMoveDef(&stolen, searchNodes - stealNodes);
+			continue;
+		}
+		if (job[0] < 0)
+			break;
+
+		//search the job, narrowing its window as the head node shares
+		//better root moves, and stopping early if it cancels the job
+		SlaveJob current;
+		current.unit = job[0];
+		current.index = job[1];
+		current.color = color;
+		current.stop = FALSE;
+		current.window.alpha = job[3];
+		current.window.beta = job[4];
+		current.window.changes = 0;
+		mainContext.poll = pollHead;
+		mainContext.pollData = &current;
+		mainContext.stop = &current.stop;
+		mainContext.window = &current.window;
+		MoveDef result;
+		result.index = current.unit;
+		long jobNodes = searchNodes;
+		if (job[2] < 0)
+		{
+			MoveSet* sub = subMoveSet(legalMoves, job[1], 1);
+			MoveDef* best = bestMoveThreaded(board, color, depth, sub, prevMove, evaluator, job[3], job[4], nodeThreads);
+			result.value = best->value;
+			free(best);
+			free(sub);
+		} else {
+			result.value = searchReply(board, color, prevMove, depth, legalMoves, job[1], job[2], evaluator, job[3], job[4]);
+		}
+		mainContext.poll = NULL;
+		mainContext.stop = NULL;
+		mainContext.window = NULL;
+
+		//the head node ignores the result of a cancelled job, but counts its nodes
+		sendMoveDef(&result, searchNodes - jobNodes);
+	}
+	destroyMoveSet(legalMoves);
 }
 
-/* Receive a move structure from the head node. */
-Move* receiveMove()
+/* Sends best move, and the nodes searched to find it, to head node. */
+void sendMoveDef(MoveDef* best, long nodes)
 {
-	Move* m = (Move*) malloc(sizeof(Move));
-	COMM_WORLD.Recv(&m->pieceId, 1, MPI_CHAR, HEAD, 0);
-	COMM_WORLD.Recv(&m->startRow, 1, MPI_CHAR, HEAD, 0);
-	COMM_WORLD.Recv(&m->startCol, 1, MPI_CHAR, HEAD, 0);
-	COMM_WORLD.Recv(&m->endRow, 1, MPI_CHAR, HEAD, 0);
-	COMM_WORLD.Recv(&m->endCol, 1, MPI_CHAR, HEAD, 0);
-	COMM_WORLD.Recv(&m->boardScore, 1, MPI_INT, HEAD, 0);
-	return m;
+	int result[RESULT_SIZE] = {best->index, best->value, (int) nodes};
+	COMM_WORLD.Send(result, RESULT_SIZE, MPI_INT, HEAD, 0);
 }
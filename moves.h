@@ -1,5 +1,6 @@
 /*	moves.h
-	by Rob Upcraft */
+	by Rob Upcraft
+	Requires boardutil.h and bitboard.h. */
 
 //Move structure
 typedef struct
@@ -17,9 +18,51 @@ typedef struct
 {
 	int cap;
 	int size;
-	Move** moves;
+	Move* moves;
 } MoveSet;
 
+//Undo record, what executeMove() on a Position needs to take a move back
+typedef struct
+{
+	char moved;		//piece id that moved (a pawn if it was promoted)
+	char captured;		//piece id captured, or EMPTY
+	char captureSquare;	//square of the captured piece (differs from the end square en passant)
+	char castleFlags;	//castling flags before the move
+	char passantSquare;	//en passant pawn before the move
+	Bitboard key;		//Zobrist key before the move
+} UndoRecord;
+
+//Root window of a search spread over the nodes, narrowed as the other
+//nodes find better root moves (see bestMove())
+typedef struct
+{
+	int alpha;
+	int beta;
+	int changes;	//times the window has been narrowed
+} RootWindow;
+
+//Per-thread search state
+#define MAX_PLY 64
+#define POLL_NODES 1024	//nodes between calls to a context's poll hook
+#define MAX_MOVES 256	//more than the legal moves of any position
+typedef struct
+{
+	long nodes;			//positions visited
+	unsigned int seed;		//state of the random tie-break at the root
+	volatile char* stop;		//set by another thread to abandon the search, or NULL
+	void (*poll)(void* data);	//called every POLL_NODES nodes, or NULL
+	void* pollData;
+	RootWindow* window;		//root window to narrow each node's window to, or NULL
+	struct SplitPoint* split;	//YBW split point whose move is being searched, or NULL
+	int worker;			//YBW worker number, or 0 when not splitting
+	char afterNull;			//set while searching the reply to a null move
+	long cutoffs;			//nodes whose search stopped early on a move that failed high
+	long firstCutoffs;		//of those, nodes where it was the first move searched
+	int killers[MAX_PLY][2];	//quiet moves (packMove()) that last failed high at each ply
+	int history[2][64][64];		//quiet move scores by color index, start and end square
+	MoveSet* plyMoves[MAX_PLY];	//reply sets for each ply, allocated on first use
+} SearchContext;
+
 /*
  * Struct for bestMoveHelper()
  */
@@ -31,12 +74,13 @@ typedef struct
 
 //Movement defines
 #define RAND_RANGE 20	//Range in which random terminal node selection is allowed
-#define CHECKMATE_VALUE 50000;
+#define CHECKMATE_VALUE 50000
 #define CASTLE -2
 #define KINGSIDE -3
 #define QUEENSIDE -4
 
 //Evaluation function defines
+#define UNSCORED 0	//generate moves without scores, see evaluateMove()
 #define ROB 1
 #define TURING 2
 #define BERLINER 3
@@ -44,14 +88,45 @@ typedef struct
 //Cluster values
 #define HEAD 0
 
+//Commands broadcast from the head node to the slave nodes
+#define COMMAND_SIZE 6	//ints in a command
+#define PLAY_COMMAND 1	//a move was played: pieceId, startRow, startCol, endRow, endCol
+#define SEARCH_COMMAND 2	//search the current position: color, depth, evaluator, position key (low, high)
+#define QUIT_COMMAND 3
+#define SETUP_COMMAND 4	//benchmark (-b): set up a verification position: index, use the cluster table
+#define COUNT_COMMAND 5	//benchmark (-b): sum the search counters, see sumSearchCounts()
+
+//Jobs sent to a slave node during a search: unit, root move index, reply
+//index (or -1 for the whole root move), alpha, beta
+#define JOB_SIZE 5
+#define CANCEL_JOB -2	//in place of the unit: stop searching the unit given next
+#define BOUND_JOB -3	//in place of the unit: a better root move, by its index and value
+#define STEAL_JOB -4	//in place of the unit: steal a split point's move from the node given next
+
+//Messages between a node stealing a YBW split point's move and the node
+//it steals from, tagged by their receiver's role
+#define VICTIM_TAG 1	//steal requests and the values of stolen moves
+#define THIEF_TAG 2	//stolen moves, and cancels of them
+
+//Results sent back to the head node: unit, value, nodes searched
+#define RESULT_SIZE 3
+
 /* Prototypes */
 MoveSet* newMoveSet();
 MoveSet* getLegalMoves(char* board, int color, Move* prevMove, int evaluator);
+MoveSet* getLegalMovesScan(char* board, int color, Move* prevMove, int evaluator);
+void generateLegalMoves(Position* pos, int color, int evaluator, MoveSet* moves);
+void generateCaptures(Position* pos, int color, int evaluator, MoveSet* moves);
 Move* getMove(MoveSet* set, int index);
 char kingInCheck(char* board, char color);
+char kingInCheckScan(char* board, char color);
 char pieceSafe(char* board, int row, int col);
+char pieceSafeScan(char* board, int row, int col);
 char spaceSafe(char* board, char color, int row, int col);
 int evaluateBoard(char* board, int functionId);
+int evaluateBoardScan(char* board, int functionId);
+int evaluatePosition(Position* pos, int functionId);
+int evaluateMove(Position* pos, Move* move, int evaluator);
 void addMove(MoveSet* set, char pieceId, int startRow, int startCol, int endRow, int endCol, int boardScore);
 void printMove(Move* move);
 char* moveToString(Move* move);
@@ -59,21 +134,39 @@ char getColumnChar(int col);
 void printMoves(MoveSet* moves);
 void destroyMoveSet(MoveSet* set);
 void executeMove(char* board, Move* move, Move* prevMove);
+void executeMove(Position* pos, Move* move, UndoRecord* undo);
+void undoMove(Position* pos, Move* move, UndoRecord* undo);
+void executeNullMove(Position* pos, UndoRecord* undo);
+void undoNullMove(Position* pos, UndoRecord* undo);
+void loadPosition(char* board, int color, Move* prevMove, Position* pos);
 char blackCastleInvalid();
 char whiteCastleInvalid();
 void setBlackCastleInvalid(char validity);
 void setWhiteCastleInvalid(char validity);
+char getCastleFlags();
+void setCastleFlags(char flags);
 Move* bestMove(char* board, int color, Move* prevMove, int depth, int evaluator);
-MoveDef* bestMoveHelper(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator);
+Move* bestMoveIterative(char* board, int color, Move* prevMove, int maxDepth, double timeLimit, long nodeLimit, int evaluator);
+MoveDef* bestMoveHelper(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta);
+MoveDef* bestMoveThreaded(char* board, int color, int depth, MoveSet* legalMoves, Move* prevMove, int evaluator, int alpha, int beta, int threads);
+void setSearchThreads(int threads);
+void setNodeThreads(int threads);
+void setSplitSearch(char enabled);
+void setSearchPruning(char enabled);
+void setNullMovePruning(char enabled);
+void setMoveReductions(char enabled);
+void initSearch();
+long getSearchNodes();
+void resetSearchNodes();
+void getCutoffCounts(long* cutoffs, long* firstCutoffs);
+void sumSearchCounts(long* counts);
 Move* newMove();
 Move* constructMove(char pieceId, char startRow, char startCol, char endRow, char endCol, int boardScore);
 Move* cloneMove(Move* m);
 MoveSet* subMoveSet(MoveSet* set, int start, int length);
 
 //Cluster prototypes
-void sendMove(int receiver, Move* move);
-Move* receiveMove();
-void sendMoveSet(int receiver, MoveSet* set);	//send a moveset to a slave node
-MoveSet* receiveMoveSet();	//receive a moveset from the head node
-void sendMoveDef(MoveDef* best);	//sends best move to head node
-MoveDef* receiveMoveDef(int sender);	//receive the best move from a slave node
+void sendMoveDef(MoveDef* best, long nodes);	//sends best move to head node
+void broadcastCommand(int* command);	//send a command to, or receive one on, every slave node
+void broadcastMove(Move* move);	//tell the slave nodes a move was played
+void serveSearch(char* board, int color, Move* prevMove, int depth, int evaluator, Bitboard key);	//search jobs from the head node
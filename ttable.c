@@ -0,0 +1,398 @@
+/*
+ * ttable.c
+ * Transposition table keyed by Zobrist position keys.
+ *
+ * The table is an array of 64-byte buckets, each holding four entries of
+ * a key and a packed data word:
+ *	bits 0-31	score
+ *	bits 32-39	depth
+ *	bits 40-41	bound type
+ *	bits 42-57	move (see packMove())
+ *
+ * Search threads share the table without locks, and so do the processes
+ * on one host, which map a single table in shared memory.  The key field
+ * holds the position key XORed with the data word, so an entry torn by
+ * two writers at once fails the key check instead of returning another
+ * position's data.  Keys are salted by evaluator (see tableKey()), so
+ * searches with different evaluators share the table without clearing it.
+ *
+ * With more than one host the table can also be spread over the cluster
+ * (see initClusterTable()).  Each host's table is its shard, exposed in an
+ * MPI window by the host's first process, and a key's bucket lives on the
+ * host chosen by its high bits.  Buckets on other hosts are read and
+ * written with one-sided Get and Put, only for nodes at least
+ * CLUSTER_DEPTH from the leaves, and the local table acts as a cache in
+ * front of them.  Buckets on the caller's host are in its own table.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stddef.h"
+#include "boardutil.h"
+#include "bitboard.h"
+#include "moves.h"
+#include "ttable.h"
+#include <mpi.h>
+
+using namespace MPI;
+
+/* Table storage */
+static TableBucket* table = NULL;
+static Bitboard bucketMask = 0;	//number of buckets - 1, a power of two
+static MPI_Comm hostComm = MPI_COMM_NULL;	//processes sharing the table, if more than one
+static int hostRank = 0;
+
+/* Cluster table storage: each host's table is its shard */
+static Win shardWindow;
+static int shardHosts = 0;	//hosts sharing the cluster table, 0 if there is none
+static int* shardOwners = NULL;	//process exposing each host's shard
+static Bitboard* shardMasks = NULL;	//bucket mask of each host's shard
+static int thisHost = 0;	//index of this process's host
+static char clusterEnabled = FALSE;
+static long clusterProbes = 0;
+static long clusterHits = 0;
+
+/* Prototypes */
+static Bitboard tableBuckets(int megabytes);
+static char findEntry(TableBucket* bucket, Bitboard key, int* score, int* depth, int* bound, int* move);
+static TableEntry* replacedEntry(TableBucket* bucket, Bitboard key, int depth, int* move);
+static Bitboard packData(int depth, int bound, int score, int move);
+
+/*
+ * Allocate a table of (at most) the given number of megabytes for each
+ * process, rounded down to a power of two number of buckets.  Processes
+ * on the same host pool their share into one table in an MPI shared
+ * memory window, so they reuse each other's results.  Every node must
+ * call it, once.
+ */
+void initTable(int megabytes)
+{
+	int hostSize;
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, COMM_WORLD.Get_rank(), MPI_INFO_NULL, &hostComm);
+	MPI_Comm_rank(hostComm, &hostRank);
+	MPI_Comm_size(hostComm, &hostSize);
+
+	Bitboard buckets = tableBuckets(megabytes * hostSize);
+	if (hostSize == 1)
+	{
+		MPI_Comm_free(&hostComm);
+		hostComm = MPI_COMM_NULL;
+		if (posix_memalign((void**) &table, 64, buckets * sizeof(TableBucket)) != 0)
+		{
+			printf("Could not allocate a %d MB transposition table.\n", megabytes);
+			exit(1);
+		}
+		bucketMask = buckets - 1;
+		clearTable();
+		return;
+	}
+
+	//the first process on the host allocates the table, the others map it
+	MPI_Win hostWindow;
+	MPI_Aint size;
+	int unit;
+	MPI_Win_allocate_shared(hostRank == 0 ? (MPI_Aint) (buckets * sizeof(TableBucket)) : 0, sizeof(TableBucket),
+		MPI_INFO_NULL, hostComm, &table, &hostWindow);
+	MPI_Win_shared_query(hostWindow, 0, &size, &unit, &table);
+	if (table == NULL || (Bitboard) size < buckets * sizeof(TableBucket))
+	{
+		printf("Could not allocate a %d MB shared transposition table.\n", megabytes * hostSize);
+		exit(1);
+	}
+	bucketMask = buckets - 1;
+	if (hostRank == 0)
+		clearTable();
+	MPI_Barrier(hostComm);
+}
+
+/*
+ * Number of buckets in a table of (at most) the given number of
+ * megabytes: the largest power of two that fits.
+ */
+static Bitboard tableBuckets(int megabytes)
+{
+	Bitboard buckets = 1;
+	Bitboard bytes = (Bitboard) megabytes * 1024 * 1024;
+	while (buckets * 2 * sizeof(TableBucket) <= bytes)
+		buckets *= 2;
+	return buckets;
+}
+
+/*
+ * Remove every entry from the table.
+ */
+void clearTable()
+{
+	memset(table, 0, (bucketMask + 1) * sizeof(TableBucket));
+}
+
+/*
+ * Remove every entry from a table shared by the processes on this host:
+ * one process clears it while the others wait.  Every node must call it,
+ * and none may be searching.
+ */
+void clearSharedTable()
+{
+	if (hostComm == MPI_COMM_NULL)
+	{
+		clearTable();
+		return;
+	}
+	if (hostRank == 0)
+		clearTable();
+	MPI_Barrier(hostComm);
+}
+
+/*
+ * Look up a position.  Returns TRUE and fills in the stored result if the
+ * position is in the table.
+ */
+char probeTable(Bitboard key, int* score, int* depth, int* bound, int* move)
+{
+	return findEntry(&table[key & bucketMask], key, score, depth, bound, move);
+}
+
+/*
+ * Store a search result.  A position already in the bucket is updated in
+ * place.  Otherwise the shallowest of the depth-preferred entries is
+ * replaced if the new result is at least as deep, and the always-replace
+ * entry is used if not.
+ */
+void storeTable(Bitboard key, int depth, int bound, int score, int move)
+{
+	TableEntry* entry = replacedEntry(&table[key & bucketMask], key, depth, &move);
+	Bitboard data = packData(depth, bound, score, move);
+	entry->key = key ^ data;
+	entry->data = data;
+}
+
+/*
+ * Find a position's entry in a bucket and unpack it.
+ */
+static char findEntry(TableBucket* bucket, Bitboard key, int* score, int* depth, int* bound, int* move)
+{
+	int i;
+	for (i = 0; i < BUCKET_ENTRIES; i++)
+	{
+		TableEntry* entry = &bucket->entries[i];
+		Bitboard data = entry->data;
+		if ((entry->key ^ data) == key && data != 0)
+		{
+			*score = (int) (unsigned int) data;
+			*depth = (int) ((data >> 32) & 0xFF);
+			*bound = (int) ((data >> 40) & 3);
+			*move = (int) ((data >> 42) & 0xFFFF);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/*
+ * Choose the entry of a bucket to store a result in, see storeTable().
+ * When the position's own entry is updated without a move, move is set
+ * to the one already stored.
+ */
+static TableEntry* replacedEntry(TableBucket* bucket, Bitboard key, int depth, int* move)
+{
+	TableEntry* entry = NULL;
+	int i;
+
+	for (i = 0; i < BUCKET_ENTRIES; i++)
+	{
+		if ((bucket->entries[i].key ^ bucket->entries[i].data) == key && bucket->entries[i].data != 0)
+		{
+			entry = &bucket->entries[i];
+			break;
+		}
+	}
+
+	if (entry == NULL)
+	{
+		entry = &bucket->entries[0];
+		for (i = 1; i < DEPTH_ENTRIES; i++)
+		{
+			if (((bucket->entries[i].data >> 32) & 0xFF) < ((entry->data >> 32) & 0xFF))
+				entry = &bucket->entries[i];
+		}
+		if (entry->data != 0 && (int) ((entry->data >> 32) & 0xFF) > depth)
+			entry = &bucket->entries[DEPTH_ENTRIES];
+	} else if (*move == NO_MOVE) {
+		*move = (int) ((entry->data >> 42) & 0xFFFF);	//keep the known best move
+	}
+	return entry;
+}
+
+/*
+ * Pack a result into an entry's data word.
+ */
+static Bitboard packData(int depth, int bound, int score, int move)
+{
+	return (Bitboard) (unsigned int) score | ((Bitboard) depth << 32) |
+		((Bitboard) bound << 40) | ((Bitboard) move << 42);
+}
+
+/*
+ * Set up the cluster table over the tables set up by initTable(): the
+ * first process on each host exposes the host's table as its shard.
+ * Every node must call it.  With a single host there is no cluster
+ * table, as its processes already share one table.
+ */
+void initClusterTable()
+{
+	int numProcs = COMM_WORLD.Get_size();
+	int rank = COMM_WORLD.Get_rank();
+	int i;
+	if (numProcs == 1)
+		return;
+
+	//number the hosts in the order of their first processes
+	int first = (hostRank == 0) ? rank : -1;
+	int* firsts = (int*) malloc(sizeof(int) * numProcs);
+	Bitboard* masks = (Bitboard*) malloc(sizeof(Bitboard) * numProcs);
+	COMM_WORLD.Allgather(&first, 1, MPI_INT, firsts, 1, MPI_INT);
+	COMM_WORLD.Allgather(&bucketMask, 1, UNSIGNED_LONG_LONG, masks, 1, UNSIGNED_LONG_LONG);
+	first = rank;
+	if (hostComm != MPI_COMM_NULL)
+		MPI_Bcast(&first, 1, MPI_INT, 0, hostComm);
+	shardOwners = (int*) malloc(sizeof(int) * numProcs);
+	shardMasks = (Bitboard*) malloc(sizeof(Bitboard) * numProcs);
+	for (i = 0; i < numProcs; i++)
+	{
+		if (firsts[i] < 0)
+			continue;
+		if (firsts[i] == first)
+			thisHost = shardHosts;
+		shardOwners[shardHosts] = i;
+		shardMasks[shardHosts] = masks[i];
+		shardHosts++;
+	}
+	free(firsts);
+	free(masks);
+	if (shardHosts == 1)
+	{
+		shardHosts = 0;	//one host, one table
+		return;
+	}
+
+	Aint size = (hostRank == 0) ? (Aint) ((bucketMask + 1) * sizeof(TableBucket)) : 0;
+	shardWindow = Win::Create(hostRank == 0 ? table : NULL, size, sizeof(TableEntry), INFO_NULL, COMM_WORLD);
+	clusterEnabled = TRUE;
+}
+
+/*
+ * Turn use of the cluster table on or off for this node's searches.
+ */
+void useClusterTable(char enabled)
+{
+	clusterEnabled = enabled && shardHosts > 0;
+}
+
+/*
+ * Wait until every host has cleared its table with clearSharedTable(),
+ * emptying the cluster table.  Every node must call it, and none may be
+ * searching.
+ */
+void clearClusterTable()
+{
+	if (shardHosts == 0)
+		return;
+	COMM_WORLD.Barrier();
+}
+
+/*
+ * Look up a position in the local table, and in the cluster table for a
+ * node at least CLUSTER_DEPTH from the leaves when the local result is
+ * missing or too shallow for the node and its bucket is on another host.
+ * A result found remotely is kept in the local table.  Only the thread
+ * making MPI calls may use it.
+ */
+char probeCluster(Bitboard key, int nodeDepth, int* score, int* depth, int* bound, int* move)
+{
+	char found = probeTable(key, score, depth, bound, move);
+	if (!clusterEnabled || nodeDepth < CLUSTER_DEPTH || (found && *depth >= nodeDepth))
+		return found;
+
+	int host = (int) ((key >> 48) % shardHosts);
+	if (host == thisHost)
+		return found;	//the local table is this host's shard
+	int owner = shardOwners[host];
+	TableBucket bucket;
+	shardWindow.Lock(LOCK_SHARED, owner, 0);
+	shardWindow.Get(&bucket, sizeof(TableBucket), BYTE, owner,
+		(Aint) (key & shardMasks[host]) * BUCKET_ENTRIES, sizeof(TableBucket), BYTE);
+	shardWindow.Unlock(owner);
+	clusterProbes++;
+
+	int remoteScore, remoteDepth, remoteBound, remoteMove;
+	if (!findEntry(&bucket, key, &remoteScore, &remoteDepth, &remoteBound, &remoteMove) ||
+		(found && remoteDepth <= *depth))
+		return found;
+
+	clusterHits++;
+	storeTable(key, remoteDepth, remoteBound, remoteScore, remoteMove);
+	*score = remoteScore;
+	*depth = remoteDepth;
+	*bound = remoteBound;
+	*move = remoteMove;
+	return TRUE;
+}
+
+/*
+ * Store a search result in the local table, and in the cluster table for
+ * a node at least CLUSTER_DEPTH from the leaves whose bucket is on
+ * another host.  The remote bucket is read
+ * to choose the entry as in storeTable(), and the entry is written under
+ * an exclusive lock.  Only the thread making MPI calls may use it.
+ */
+void storeCluster(Bitboard key, int depth, int bound, int score, int move)
+{
+	storeTable(key, depth, bound, score, move);
+	if (!clusterEnabled || depth < CLUSTER_DEPTH)
+		return;
+
+	int host = (int) ((key >> 48) % shardHosts);
+	if (host == thisHost)
+		return;	//the local table is this host's shard
+	int owner = shardOwners[host];
+	Aint bucketStart = (Aint) (key & shardMasks[host]) * BUCKET_ENTRIES;
+	TableBucket bucket;
+	shardWindow.Lock(LOCK_SHARED, owner, 0);
+	shardWindow.Get(&bucket, sizeof(TableBucket), BYTE, owner, bucketStart, sizeof(TableBucket), BYTE);
+	shardWindow.Unlock(owner);
+
+	TableEntry* entry = replacedEntry(&bucket, key, depth, &move);
+	Bitboard data = packData(depth, bound, score, move);
+	entry->key = key ^ data;
+	entry->data = data;
+	shardWindow.Lock(LOCK_EXCLUSIVE, owner, 0);
+	shardWindow.Put((void*) entry, sizeof(TableEntry), BYTE, owner, bucketStart + (entry - bucket.entries),
+		sizeof(TableEntry), BYTE);
+	shardWindow.Unlock(owner);
+}
+
+/*
+ * Get the number of remote cluster table probes and of those that found
+ * a result, and reset both.
+ */
+void getClusterCounts(long* probes, long* hits)
+{
+	*probes = clusterProbes;
+	*hits = clusterHits;
+	clusterProbes = 0;
+	clusterHits = 0;
+}
+
+/*
+ * Pack a move into 16 bits for the table: the start square, the end
+ * square shifted by 6, and bit 12 (kingside) or 13 (queenside) for a
+ * castle.  Bit 15 marks a move so that no move packs to NO_MOVE.
+ */
+int packMove(Move* move)
+{
+	if (move->startRow == CASTLE)
+		return (1 << 15) | (move->endRow == KINGSIDE ? (1 << 12) : (1 << 13));
+	return (1 << 15) | SQUARE(move->startRow, move->startCol) | (SQUARE(move->endRow, move->endCol) << 6);
+}
@@ -0,0 +1,57 @@
+/*
+ * ttable.h
+ * Transposition table keyed by Zobrist position keys.
+ * Requires bitboard.h and moves.h.
+ */
+
+/* Types */
+//Table entry: the full key and one packed word of search data
+typedef struct
+{
+	volatile Bitboard key;	//position key XOR data
+	volatile Bitboard data;	//score, depth, bound and move, see ttable.c
+} TableEntry;
+
+//Bucket of entries sharing one 64-byte cache line
+typedef struct
+{
+	TableEntry entries[4];
+} TableBucket;
+
+/* Defines */
+#define BUCKET_ENTRIES 4
+#define DEPTH_ENTRIES 3	//entries 0-2 keep the deepest results, entry 3 is always replaced
+
+//Bound types
+#define EXACT_BOUND 0	//score is the value of the position
+#define LOWER_BOUND 1	//value is at least score (search failed high)
+#define UPPER_BOUND 2	//value is at most score (search failed low)
+
+#define NO_MOVE 0
+
+#define EVALUATOR_SALT 0x9E3779B97F4A7C15ULL	//mixed into keys by evaluator, see tableKey()
+
+//Cluster table
+#define CLUSTER_DEPTH 1	//nodes closer to the leaves use only the local table
+
+/* Key of a position's results found with an evaluator.  Results of
+ * different evaluators are kept apart by salting the Zobrist key, so a
+ * table shared by several searches never has to be cleared between them. */
+inline Bitboard tableKey(Bitboard key, int evaluator)
+{
+	return key ^ ((Bitboard) evaluator * EVALUATOR_SALT);
+}
+
+/* Prototypes */
+void initTable(int megabytes);
+void clearTable();
+void clearSharedTable();
+char probeTable(Bitboard key, int* score, int* depth, int* bound, int* move);
+void storeTable(Bitboard key, int depth, int bound, int score, int move);
+int packMove(Move* move);
+void initClusterTable();
+void useClusterTable(char enabled);
+void clearClusterTable();
+char probeCluster(Bitboard key, int nodeDepth, int* score, int* depth, int* bound, int* move);
+void storeCluster(Bitboard key, int depth, int bound, int score, int move);
+void getClusterCounts(long* probes, long* hits);